@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "clara.hpp"
+#include "config.hpp"
+#include "data_structure.hpp"
+#include "raptor.hpp"
+#include "synthetic.hpp"
+
+std::string name;
+bool use_hl;
+bool profile;
+bool ranked;
+bool use_snapshot;
+bool verify_snapshot;
+std::size_t n_threads = 1;
+int range_window = 0;
+bool record_journeys;
+bool multi_criteria;
+bool arrive_by;
+bool record_stats;
+bool record_perf;
+
+
+namespace {
+    struct BenchQuery {
+        node_id_t source_id;
+        node_id_t target_id;
+        Time dep;
+    };
+
+
+    // The statistics of the time per operation over the repetitions of a benchmark, in nanoseconds
+    void report(const std::string& benchmark, const size_t& n_ops, std::vector<double> ns_per_op) {
+        std::sort(ns_per_op.begin(), ns_per_op.end());
+
+        const auto n = ns_per_op.size();
+        const double median = n % 2 == 1 ? ns_per_op[n / 2] : (ns_per_op[n / 2 - 1] + ns_per_op[n / 2]) / 2;
+
+        double mean = 0;
+        for (const auto& x: ns_per_op) mean += x / static_cast<double>(n);
+
+        double variance = 0;
+        for (const auto& x: ns_per_op) variance += (x - mean) * (x - mean) / static_cast<double>(n);
+
+        std::cout << std::left << std::setw(22) << benchmark << std::right << std::setw(10) << n_ops
+                  << std::fixed << std::setprecision(1)
+                  << std::setw(12) << ns_per_op.front() << std::setw(12) << median
+                  << std::setw(12) << mean << std::setw(12) << std::sqrt(variance) << std::endl;
+    }
+
+
+    // Search the earliest trips of random routes at random stops and times
+    void bench_earliest_trip(const Timetable& timetable, Raptor& raptor, const CityConfig& config,
+                             const size_t& n_repeats) {
+        struct Lookup {
+            const Route* route;
+            size_t stop_idx;
+            Time t;
+        };
+
+        std::mt19937 generator {config.seed};
+        std::vector<Lookup> lookups;
+        const auto last_departure = config.first_departure + static_cast<Time::value_type>(config.n_trips) *
+                                                             config.headway;
+        std::uniform_int_distribution<Time::value_type> time_dist(config.first_departure, last_departure);
+
+        while (lookups.size() < 100000) {
+            const auto& route = timetable.routes[generator() % timetable.routes.size()];
+            if (route.n_stops < 2 || route.n_trips == 0) continue;
+
+            lookups.push_back({&route, generator() % (route.n_stops - 1), Time(time_dist(generator))});
+        }
+
+        std::vector<double> ns_per_op;
+
+        for (size_t rep = 0; rep <= n_repeats; ++rep) {
+            Timer timer;
+
+            for (const auto& lookup: lookups) {
+                raptor.earliest_trip(*lookup.route, lookup.stop_idx, lookup.t, lookup.route->n_trips);
+            }
+
+            // The first repetition warms up the caches
+            if (rep > 0) ns_per_op.push_back(timer.elapsed() * 1e6 / static_cast<double>(lookups.size()));
+        }
+
+        report("earliest trip", lookups.size(), ns_per_op);
+    }
+
+
+    // Run the queries stage by stage, and time each stage separately
+    void bench_stages(Raptor& raptor, const std::vector<BenchQuery>& queries, const size_t& n_repeats) {
+        const std::vector<std::string> stage_names {"copy labels", "make queue", "route scan", "scan footpaths"};
+        std::vector<std::vector<double>> ns_per_op(stage_names.size());
+        std::vector<size_t> n_calls(stage_names.size());
+
+        for (size_t rep = 0; rep <= n_repeats; ++rep) {
+            std::vector<double> elapsed(stage_names.size(), 0);
+            std::fill(n_calls.begin(), n_calls.end(), 0);
+
+            auto timed = [&](const size_t& stage, const Timer& timer) {
+                elapsed[stage] += timer.elapsed();
+                ++n_calls[stage];
+            };
+
+            for (const auto& query: queries) {
+                raptor.begin_query(query.source_id, query.target_id, query.dep);
+
+                while (true) {
+                    Timer timer;
+                    raptor.copy_labels();
+                    timed(0, timer);
+
+                    timer.reset();
+                    raptor.make_queue();
+                    timed(1, timer);
+
+                    timer.reset();
+                    const bool scan_footpaths = raptor.scan_round_routes();
+                    timed(2, timer);
+
+                    if (!scan_footpaths) break;
+
+                    timer.reset();
+                    raptor.scan_round_footpaths();
+                    timed(3, timer);
+                }
+            }
+
+            for (size_t stage = 0; rep > 0 && stage < stage_names.size(); ++stage) {
+                const auto n = static_cast<double>(std::max<size_t>(1, n_calls[stage]));
+                ns_per_op[stage].push_back(elapsed[stage] * 1e6 / n);
+            }
+        }
+
+        for (size_t stage = 0; stage < stage_names.size(); ++stage) {
+            report(stage_names[stage], n_calls[stage], ns_per_op[stage]);
+        }
+    }
+
+
+    void bench_queries(Raptor& raptor, const std::vector<BenchQuery>& queries, const size_t& n_repeats) {
+        std::vector<double> ns_per_op;
+
+        for (size_t rep = 0; rep <= n_repeats; ++rep) {
+            Timer timer;
+
+            for (const auto& query: queries) {
+                raptor.query(query.source_id, query.target_id, query.dep);
+            }
+
+            if (rep > 0) ns_per_op.push_back(timer.elapsed() * 1e6 / static_cast<double>(queries.size()));
+        }
+
+        report("query", queries.size(), ns_per_op);
+    }
+}
+
+
+int main(int argc, char* argv[]) {
+    bool show_help = false;
+    CityConfig config;
+    std::string dir = "synthetic/";
+    size_t n_queries = 200;
+    size_t n_repeats = 10;
+
+    auto cli_parser = clara::Opt(config.layout, "grid|radial")["--layout"]("The layout of the stops of the city") |
+                      clara::Opt(config.n_stops, "stops")["--stops"]("The number of stops") |
+                      clara::Opt(config.n_routes, "routes")["--routes"]("The number of routes") |
+                      clara::Opt(config.n_trips, "trips")["--trips"]("The number of trips of each route") |
+                      clara::Opt(config.headway, "seconds")["--headway"]("The time between the trips of a route") |
+                      clara::Opt(config.jitter, "seconds")["--jitter"]
+                              ("The maximum random delay of a trip between two stops") |
+                      clara::Opt(config.cluster_size, "metres")["--cluster"]
+                              ("The side of the squares whose stops are linked by footpaths") |
+                      clara::Opt(config.seed, "seed")["--seed"]("The seed of the city and the queries") |
+                      clara::Opt(n_queries, "queries")["--queries"]("The number of queries") |
+                      clara::Opt(n_repeats, "repeats")["--repeats"]("The number of repetitions of each benchmark") |
+                      clara::Opt(dir, "dir")["--dir"]("The directory where the city is written") |
+                      clara::Opt(use_hl)["--hl"]("Walk with the hub labels instead of the footpaths") |
+                      clara::Help(show_help);
+
+    auto result = cli_parser.parse(clara::Args(argc, argv));
+    if (!result) {
+        std::cerr << "Error in command line: " << result.errorMessage() << std::endl;
+        cli_parser.writeToStream(std::cout);
+        exit(1);
+    }
+    if (show_help) {
+        cli_parser.writeToStream(std::cout);
+        return 0;
+    }
+
+    n_repeats = std::max<size_t>(1, n_repeats);
+
+    if (dir.empty() || dir.back() != '/') dir += '/';
+
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cerr << "Cannot create the directory " << dir << std::endl;
+        exit(1);
+    }
+
+    std::unique_ptr<Timetable> timetable;
+    try {
+        write_city(config, dir);
+        timetable.reset(new Timetable {dir});
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Error while generating the city: " << e.what() << std::endl;
+        exit(1);
+    }
+
+    name = config.layout;
+    timetable->summary();
+
+    std::cout << "Walking with " << (use_hl ? "hub labelling" : "the footpaths") << std::endl;
+
+    std::vector<node_id_t> stop_ids;
+    for (const auto& stop: timetable->stops) {
+        if (stop.is_valid()) stop_ids.push_back(stop.id);
+    }
+
+    // The queries leave during the first half of the service
+    std::mt19937 generator {config.seed};
+    const auto last_departure = config.first_departure + static_cast<Time::value_type>(config.n_trips) *
+                                                         config.headway / 2;
+    std::uniform_int_distribution<Time::value_type> time_dist(config.first_departure, last_departure);
+
+    std::vector<BenchQuery> queries;
+    for (size_t i = 0; i < n_queries; ++i) {
+        const auto source_id = stop_ids[generator() % stop_ids.size()];
+        const auto target_id = stop_ids[generator() % stop_ids.size()];
+
+        queries.push_back({source_id, target_id, Time(time_dist(generator))});
+    }
+
+    Raptor raptor {timetable.get()};
+
+    std::cout << std::left << std::setw(22) << "benchmark" << std::right << std::setw(10) << "ops"
+              << std::setw(12) << "min ns" << std::setw(12) << "median ns"
+              << std::setw(12) << "mean ns" << std::setw(12) << "stddev ns" << std::endl;
+
+    bench_earliest_trip(*timetable, raptor, config, n_repeats);
+    bench_stages(raptor, queries, n_repeats);
+    bench_queries(raptor, queries, n_repeats);
+
+    return 0;
+}
@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <zlib.h>
+
+#include "synthetic.hpp"
+
+
+namespace {
+    // The speed of the vehicles and of the walks, in metres per second,
+    // and the time the vehicles stay at each stop
+    const double driving_speed = 10;
+    const double walking_speed = 1.4;
+    const Time::value_type dwell_time = 20;
+
+    struct Point {
+        double x;
+        double y;
+    };
+
+    double distance(const Point& p1, const Point& p2) {
+        return std::hypot(p1.x - p2.x, p1.y - p2.y);
+    }
+
+    void write_gz(const std::string& file_path, const std::string& content) {
+        gzFile file = gzopen(file_path.c_str(), "wb");
+
+        if (file == nullptr) {
+            throw std::runtime_error("Cannot write " + file_path);
+        }
+
+        const auto n_bytes = gzwrite(file, content.data(), static_cast<unsigned>(content.size()));
+        gzclose(file);
+
+        if (n_bytes != static_cast<int>(content.size())) {
+            throw std::runtime_error("Cannot write " + file_path);
+        }
+    }
+
+
+    // The stops on a square grid, and the rows and the columns of the grid, alternately
+    void make_grid(const CityConfig& config, std::vector<Point>& points, std::vector<std::vector<node_id_t>>& lines) {
+        const auto side = static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(config.n_stops))));
+        const auto n_rows = (config.n_stops + side - 1) / side;
+
+        for (std::size_t i = 0; i < config.n_stops; ++i) {
+            points.push_back({static_cast<double>(i % side) * config.spacing,
+                              static_cast<double>(i / side) * config.spacing});
+        }
+
+        for (std::size_t k = 0; k < std::max(n_rows, side); ++k) {
+            if (k < n_rows) {
+                lines.emplace_back();
+                for (std::size_t i = k * side; i < std::min(config.n_stops, (k + 1) * side); ++i) {
+                    lines.back().push_back(static_cast<node_id_t>(i));
+                }
+            }
+
+            if (k < side) {
+                lines.emplace_back();
+                for (std::size_t i = k; i < config.n_stops; i += side) {
+                    lines.back().push_back(static_cast<node_id_t>(i));
+                }
+            }
+        }
+    }
+
+
+    // A stop at the centre and the other stops on rings around it, at the crossings with the spokes.
+    // The lines are the diameters, or the spokes if there is an odd number of them, and the rings,
+    // which go back to their first stop when they are complete.
+    void make_radial(const CityConfig& config, std::vector<Point>& points,
+                     std::vector<std::vector<node_id_t>>& lines) {
+        const auto n_spokes = std::max<std::size_t>(
+                4, static_cast<std::size_t>(std::round(std::sqrt(static_cast<double>(config.n_stops)))));
+        const auto n_rings = config.n_stops > 1 ? (config.n_stops - 2) / n_spokes + 1 : 0;
+        const double pi = std::acos(-1.0);
+
+        auto stop_id = [&](const std::size_t& ring, const std::size_t& spoke) {
+            return static_cast<node_id_t>(1 + ring * n_spokes + spoke);
+        };
+
+        points.push_back({0, 0});
+        for (std::size_t i = 1; i < config.n_stops; ++i) {
+            const auto radius = static_cast<double>((i - 1) / n_spokes + 1) * config.spacing;
+            const auto angle = 2 * pi * static_cast<double>((i - 1) % n_spokes) / static_cast<double>(n_spokes);
+
+            points.push_back({radius * std::cos(angle), radius * std::sin(angle)});
+        }
+
+        const auto n_diameters = n_spokes % 2 == 0 ? n_spokes / 2 : n_spokes;
+        for (std::size_t spoke = 0; spoke < n_diameters; ++spoke) {
+            lines.emplace_back();
+            auto& line = lines.back();
+
+            if (n_spokes % 2 == 0) {
+                for (std::size_t ring = n_rings; ring-- > 0;) {
+                    if (stop_id(ring, spoke + n_spokes / 2) < config.n_stops) {
+                        line.push_back(stop_id(ring, spoke + n_spokes / 2));
+                    }
+                }
+            }
+
+            line.push_back(0);
+
+            for (std::size_t ring = 0; ring < n_rings; ++ring) {
+                if (stop_id(ring, spoke) < config.n_stops) line.push_back(stop_id(ring, spoke));
+            }
+        }
+
+        for (std::size_t ring = 0; ring < n_rings; ++ring) {
+            lines.emplace_back();
+            auto& line = lines.back();
+
+            for (std::size_t spoke = 0; spoke < n_spokes; ++spoke) {
+                if (stop_id(ring, spoke) < config.n_stops) line.push_back(stop_id(ring, spoke));
+            }
+
+            if (line.size() == n_spokes) line.push_back(line.front());
+        }
+    }
+}
+
+
+void write_city(const CityConfig& config, const std::string& dir) {
+    std::mt19937 generator {config.seed};
+    std::uniform_int_distribution<Time::value_type> delay(0, config.jitter);
+
+    std::vector<Point> points;
+    std::vector<std::vector<node_id_t>> lines;
+
+    if (config.layout == "grid") {
+        make_grid(config, points, lines);
+    } else if (config.layout == "radial") {
+        make_radial(config, points, lines);
+    } else {
+        throw std::runtime_error("Unknown layout " + config.layout + ", expected grid or radial");
+    }
+
+    lines.erase(std::remove_if(lines.begin(), lines.end(),
+                               [](const std::vector<node_id_t>& line) { return line.size() < 2; }), lines.end());
+
+    if (lines.empty() || config.n_routes == 0) {
+        throw std::runtime_error("The city has no route");
+    }
+
+    std::ostringstream trips;
+    std::ostringstream stop_routes;
+    std::ostringstream stop_times;
+    std::ostringstream transfers;
+    std::ostringstream in_hubs;
+    std::ostringstream out_hubs;
+
+    trips << "route_id,trip_id\n";
+    stop_routes << "stop_id,route_id\n";
+    stop_times << "trip_id,arrival_time,departure_time,stop_id\n";
+    transfers << "from_stop_id,to_stop_id,min_transfer_time\n";
+
+    // The routes are spread over the lines, and the lines used by several routes are run in both directions
+    trip_id_t trip_id = 0;
+    for (std::size_t r = 0; r < config.n_routes; ++r) {
+        const bool spread = config.n_routes <= lines.size();
+        auto line = lines[spread ? r * lines.size() / config.n_routes : r % lines.size()];
+
+        if (spread ? r % 2 == 1 : (r / lines.size()) % 2 == 1) {
+            std::reverse(line.begin(), line.end());
+        }
+
+        std::vector<node_id_t> served_stops {line};
+        std::sort(served_stops.begin(), served_stops.end());
+        served_stops.erase(std::unique(served_stops.begin(), served_stops.end()), served_stops.end());
+
+        for (const auto& stop_id: served_stops) {
+            stop_routes << stop_id << ',' << r << '\n';
+        }
+
+        // A trip never arrives at a stop before the previous trip, so that the trips do not overtake each other
+        const auto headway = static_cast<Time::value_type>(1 + r % 3) * config.headway;
+        std::vector<Time::value_type> prev_arrivals(line.size(), 0);
+
+        for (std::size_t k = 0; k < config.n_trips; ++k, ++trip_id) {
+            trips << r << ',' << trip_id << '\n';
+
+            Time::value_type dep = config.first_departure + static_cast<Time::value_type>(k) * headway;
+
+            for (std::size_t i = 0; i < line.size(); ++i) {
+                Time::value_type arr = dep;
+
+                if (i > 0) {
+                    const auto driving_time = distance(points[line[i - 1]], points[line[i]]) / driving_speed;
+                    arr += static_cast<Time::value_type>(std::ceil(driving_time)) + delay(generator);
+                }
+
+                arr = std::max(arr, prev_arrivals[i]);
+                prev_arrivals[i] = arr;
+                dep = i == 0 ? arr : arr + dwell_time;
+
+                stop_times << trip_id << ',' << arr << ',' << dep << ',' << line[i] << '\n';
+            }
+        }
+    }
+
+    // The footpaths link the stops lying in the same square cell of side cluster_size, every stop to every other
+    // stop of its cell. The walking times are given by the straight-line distances, so within a cell walking
+    // directly is never slower than through another stop, and the footpaths are transitively closed as RAPTOR
+    // assumes. The hub labels use the stops as the nodes of the road network, the hubs of a stop are the stops
+    // of its cell, including itself at distance 0, so that they give the same walks. The distances are in decimetres.
+    std::map<std::pair<long, long>, std::vector<std::size_t>> cells;
+    for (std::size_t i = 0; i < points.size(); ++i) {
+        cells[{std::lround(std::floor(points[i].x / config.cluster_size)),
+               std::lround(std::floor(points[i].y / config.cluster_size))}].push_back(i);
+    }
+
+    for (const auto& cell: cells) {
+        for (const auto& i: cell.second) {
+            for (const auto& j: cell.second) {
+                const auto d = distance(points[i], points[j]);
+                const auto hub_distance = static_cast<distance_t>(std::ceil(d * 10));
+
+                in_hubs << i << ' ' << j << ' ' << hub_distance << '\n';
+                out_hubs << i << ' ' << j << ' ' << hub_distance << '\n';
+
+                if (i != j) {
+                    const auto walking_time = static_cast<Time::value_type>(std::ceil(d / walking_speed));
+                    transfers << i << ',' << j << ',' << walking_time << '\n';
+                }
+            }
+        }
+    }
+
+    write_gz(dir + "trips.csv.gz", trips.str());
+    write_gz(dir + "stop_routes.csv.gz", stop_routes.str());
+    write_gz(dir + "stop_times.csv.gz", stop_times.str());
+    write_gz(dir + "transfers.csv.gz", transfers.str());
+    write_gz(dir + "in_hubs.gr.gz", in_hubs.str());
+    write_gz(dir + "out_hubs.gr.gz", out_hubs.str());
+}
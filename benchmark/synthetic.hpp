@@ -0,0 +1,35 @@
+#ifndef SYNTHETIC_HPP
+#define SYNTHETIC_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "data_structure.hpp"
+
+
+// The parameters of a synthetic city. The stops are laid out on a square grid, or on rings around a centre,
+// and the routes follow the rows and the columns of the grid, or the diameters and the rings.
+// The trips of the route r leave its first stop every (1 + r % 3) * headway seconds from first_departure,
+// each hop takes the time to drive between the stops plus a random delay of at most jitter seconds,
+// so that the routes are periodic if jitter is 0. The plane is split into square cells of side cluster_size,
+// and the stops of a cell are all linked by footpaths, and are hubs of each other in the hub labels.
+struct CityConfig {
+    std::string layout = "grid";
+    std::size_t n_stops = 1600;
+    std::size_t n_routes = 80;
+    std::size_t n_trips = 100;
+    Time::value_type headway = 600;
+    Time::value_type first_departure = 6 * 3600;
+    Time::value_type jitter = 0;
+    double spacing = 400;
+    double cluster_size = 600;
+    uint32_t seed = 42;
+};
+
+
+// Write the dataset files of the city in the directory, in the format read by the timetable.
+// The same configuration always gives the same files.
+void write_city(const CityConfig& config, const std::string& dir);
+
+#endif // SYNTHETIC_HPP
@@ -3,13 +3,13 @@
 
 #include "hub_labelling.hpp"
 #include "csv.h"
-#include "gzstream.h"
+#include "gz_source.hpp"
 
 extern const Distance infty = std::numeric_limits<Distance>::max();
 
 void GraphLabel::parse_hub_files() {
-    igzstream in_hubs_file_stream {(_path + "in_hubs.gr.gz").c_str()};
-    io::CSVReader<3, io::trim_chars<>, io::no_quote_escape<' '>> in_hubs_reader {"in_hubs.gr", in_hubs_file_stream};
+    io::CSVReader<3, io::trim_chars<>, io::no_quote_escape<' '>> in_hubs_reader {"in_hubs.gr",
+        open_gz(_path + "in_hubs.gr.gz")};
     in_hubs_reader.set_header("node_id", "stop_id", "distance");
 
     Node node_id;
@@ -21,8 +21,8 @@ void GraphLabel::parse_hub_files() {
         in_labels[stop_id].distances.emplace_back(distance);
     }
 
-    igzstream out_hubs_file_stream {(_path + "out_hubs.gr.gz").c_str()};
-    io::CSVReader<3, io::trim_chars<>, io::no_quote_escape<' '>> out_hubs_reader {"out_hubs.gr", out_hubs_file_stream};
+    io::CSVReader<3, io::trim_chars<>, io::no_quote_escape<' '>> out_hubs_reader {"out_hubs.gr",
+        open_gz(_path + "out_hubs.gr.gz")};
     out_hubs_reader.set_header("stop_id", "node_id", "distance");
 
     while (out_hubs_reader.read_row(stop_id, node_id, distance)) {
@@ -34,8 +34,7 @@ void GraphLabel::parse_hub_files() {
 }
 
 void GraphLabel::parse_weights() {
-    igzstream trips_file_stream {(_path + "trips.csv.gz").c_str()};
-    io::CSVReader<1> trips_file_reader {"trips.csv", trips_file_stream};
+    io::CSVReader<1> trips_file_reader {"trips.csv", open_gz(_path + "trips.csv.gz")};
     trips_file_reader.read_header(io::ignore_missing_column, "route_id");
 
     route_id_t route_id;
@@ -55,8 +54,7 @@ void GraphLabel::parse_weights() {
         stop_to_weight[kv.first] = 0;
     }
 
-    igzstream stop_routes_file_stream {(_path + "stop_routes.csv.gz").c_str()};
-    io::CSVReader<2> stop_routes_reader {"stop_routes.csv", stop_routes_file_stream};
+    io::CSVReader<2> stop_routes_reader {"stop_routes.csv", open_gz(_path + "stop_routes.csv.gz")};
     stop_routes_reader.read_header(io::ignore_no_column, "stop_id", "route_id");
 
     Node stop_id;
@@ -0,0 +1,124 @@
+#ifndef GZ_SOURCE_HPP
+#define GZ_SOURCE_HPP
+
+#include <cerrno>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "csv.h"
+
+
+// A source of bytes for io::CSVReader which reads a gzip file, or a plain file, through zlib.
+// The reader asks for blocks of 16 MiB, which are decompressed directly into its buffer,
+// and since it reads the next block on its own thread, the decompression runs while
+// the previous block is parsed.
+class GzByteSource : public io::ByteSourceBase {
+private:
+    gzFile m_file;
+    std::string m_file_path;
+
+public:
+    explicit GzByteSource(const std::string& file_path) : m_file_path {file_path} {
+        m_file = gzopen(file_path.c_str(), "rb");
+
+        if (m_file == nullptr) {
+            io::error::can_not_open_file err;
+            err.set_errno(errno);
+            err.set_file_name(file_path.c_str());
+            throw err;
+        }
+
+        // The compressed data is also read by large blocks
+        gzbuffer(m_file, 1 << 20);
+    }
+
+    GzByteSource(const GzByteSource&) = delete;
+
+    GzByteSource& operator=(const GzByteSource&) = delete;
+
+    int read(char* buffer, int size) override {
+        // gzread only returns less than the requested size at the end of the file
+        int n_bytes = gzread(m_file, buffer, static_cast<unsigned>(size));
+
+        if (n_bytes < 0) {
+            int err_code;
+            throw std::runtime_error("Cannot decompress " + m_file_path + ": " + gzerror(m_file, &err_code));
+        }
+
+        return n_bytes;
+    }
+
+    ~GzByteSource() override {
+        gzclose(m_file);
+    }
+};
+
+
+// Open the file as the source of a io::CSVReader
+inline std::unique_ptr<io::ByteSourceBase> open_gz(const std::string& file_path) {
+    return std::unique_ptr<io::ByteSourceBase> {new GzByteSource {file_path}};
+}
+
+
+// Read a file by chunks of about chunk_size bytes made of whole lines, one chunk at a time, so that
+// a chunk can be parsed while the next one is decompressed. Each chunk begins with the header line
+// of the file, so that the chunks can be parsed independently by several io::CSVReader.
+class GzChunkReader {
+private:
+    GzByteSource m_source;
+    std::vector<char> m_block;
+    std::string m_header;
+    std::string m_data;
+    bool m_has_header = false;
+    bool m_at_end = false;
+    bool m_has_chunk = false;
+
+public:
+    GzChunkReader(const std::string& file_path, const std::size_t& chunk_size) :
+            m_source {file_path}, m_block(chunk_size) {}
+
+    // Get the next chunk, return false once the whole file has been read
+    bool next(std::string& chunk) {
+        while (!m_at_end) {
+            const int n_bytes = m_source.read(m_block.data(), static_cast<int>(m_block.size()));
+            m_data.append(m_block.data(), static_cast<std::size_t>(n_bytes));
+            m_at_end = n_bytes == 0;
+
+            if (!m_has_header) {
+                const auto eol = m_data.find('\n');
+                if (eol == std::string::npos && !m_at_end) continue;
+
+                m_header = m_data.substr(0, eol == std::string::npos ? m_data.size() : eol + 1);
+                m_data.erase(0, m_header.size());
+                m_has_header = true;
+            }
+
+            // The last line of the block is incomplete, except at the end of the file
+            const auto end = m_at_end ? m_data.size() : m_data.rfind('\n') + 1;
+
+            if (end > 0) {
+                chunk = m_header;
+                chunk.append(m_data, 0, end);
+                m_data.erase(0, end);
+                m_has_chunk = true;
+                return true;
+            }
+        }
+
+        // An empty file still gives a chunk, so that the missing header is reported by the reader
+        if (!m_has_chunk) {
+            chunk = m_header;
+            m_has_chunk = true;
+            return true;
+        }
+
+        return false;
+    }
+};
+
+
+#endif // GZ_SOURCE_HPP
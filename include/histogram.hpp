@@ -0,0 +1,94 @@
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+
+// A histogram of non-negative integers with logarithmic buckets, as in HdrHistogram. The values below
+// 2 * half_count have their own bucket, then each power of two [2^k, 2^(k+1)) is split into half_count buckets
+// of the same width, so a value is known up to a relative error of 1 / half_count whatever its magnitude.
+// Recording a value only increments a counter, and the histograms of several threads are merged by adding them.
+class Histogram {
+private:
+    static const unsigned sub_bits = 7;
+    static const uint64_t sub_count = uint64_t(1) << sub_bits;
+    static const uint64_t half_count = sub_count / 2;
+
+    std::vector<uint64_t> m_counts;
+    uint64_t m_total = 0;
+    uint64_t m_min = std::numeric_limits<uint64_t>::max();
+    uint64_t m_max = 0;
+
+    static unsigned msb(uint64_t value) {
+        unsigned k = 0;
+        while (value >>= 1) ++k;
+        return k;
+    }
+
+    static std::size_t bucket(const uint64_t& value) {
+        if (value < sub_count) return static_cast<std::size_t>(value);
+
+        const auto shift = msb(value) - (sub_bits - 1);
+        return static_cast<std::size_t>(sub_count + (shift - 1) * half_count + ((value >> shift) - half_count));
+    }
+
+    // The largest value of the bucket
+    static uint64_t highest_value(const std::size_t& idx) {
+        if (idx < sub_count) return idx;
+
+        const auto shift = (idx - sub_count) / half_count + 1;
+        const auto sub_idx = (idx - sub_count) % half_count + half_count;
+        return ((sub_idx + 1) << shift) - 1;
+    }
+
+public:
+    Histogram() : m_counts(bucket(std::numeric_limits<uint64_t>::max()) + 1, 0) {}
+
+    void record(const uint64_t& value) {
+        ++m_counts[bucket(value)];
+        ++m_total;
+        m_min = std::min(m_min, value);
+        m_max = std::max(m_max, value);
+    }
+
+    void merge(const Histogram& other) {
+        for (std::size_t i = 0; i < m_counts.size(); ++i) {
+            m_counts[i] += other.m_counts[i];
+        }
+
+        m_total += other.m_total;
+        m_min = std::min(m_min, other.m_min);
+        m_max = std::max(m_max, other.m_max);
+    }
+
+    const uint64_t& count() const { return m_total; }
+
+    uint64_t min() const { return m_total > 0 ? m_min : 0; }
+
+    const uint64_t& max() const { return m_max; }
+
+    // The smallest value such that at least the given percentage of the values are not larger,
+    // up to the width of its bucket. The exact minimum and maximum are kept.
+    uint64_t percentile(const double& percent) const {
+        if (m_total == 0) return 0;
+
+        const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(
+                std::ceil(percent / 100 * static_cast<double>(m_total))));
+        uint64_t n_values = 0;
+
+        for (std::size_t i = 0; i < m_counts.size(); ++i) {
+            n_values += m_counts[i];
+
+            if (n_values >= rank) return std::max(m_min, std::min(highest_value(i), m_max));
+        }
+
+        return m_max;
+    }
+};
+
+#endif // HISTOGRAM_HPP
@@ -0,0 +1,227 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility> // std::move
+#include <vector>
+
+
+// The chunks of work owned by each thread. A thread takes its own chunks from the front of its range,
+// and once its range is empty, it steals chunks from the back of the ranges of the other threads,
+// so that the threads which get the expensive chunks do not delay the whole batch.
+class WorkStealingRanges {
+private:
+    struct Range {
+        std::mutex mutex;
+        std::size_t front = 0;
+        std::size_t back = 0;
+        char padding[64];  // Keep the ranges of different threads on different cache lines
+    };
+
+    std::unique_ptr<Range[]> m_ranges;
+    std::size_t m_n_threads;
+
+public:
+    // Split the chunks [0, n_chunks) into n_threads contiguous ranges of (almost) the same size
+    WorkStealingRanges(const std::size_t& n_chunks, const std::size_t& n_threads) :
+            m_ranges {new Range[n_threads]}, m_n_threads {n_threads} {
+        for (std::size_t i = 0; i < n_threads; ++i) {
+            m_ranges[i].front = n_chunks * i / n_threads;
+            m_ranges[i].back = n_chunks * (i + 1) / n_threads;
+        }
+    }
+
+    // Get the next chunk for the thread, return false if there is no chunk left anywhere
+    bool next(const std::size_t& thread_idx, std::size_t& chunk) {
+        {
+            auto& own = m_ranges[thread_idx];
+            std::lock_guard<std::mutex> lock {own.mutex};
+
+            if (own.front < own.back) {
+                chunk = own.front++;
+                return true;
+            }
+        }
+
+        for (std::size_t i = 1; i < m_n_threads; ++i) {
+            auto& victim = m_ranges[(thread_idx + i) % m_n_threads];
+            std::lock_guard<std::mutex> lock {victim.mutex};
+
+            if (victim.front < victim.back) {
+                chunk = --victim.back;
+                return true;
+            }
+        }
+
+        return false;
+    }
+};
+
+
+// A queue of at most capacity items between the threads producing them and the threads consuming them.
+// A producer waits while the queue is full, so that the items do not pile up when they are produced faster
+// than they are consumed, and a consumer waits while the queue is empty. Once the queue is closed,
+// no item is added anymore, and the consumers take the remaining items.
+template<class T>
+class BoundedQueue {
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_not_empty;
+    std::condition_variable m_not_full;
+    std::deque<T> m_items;
+    const std::size_t m_capacity;
+    bool m_closed = false;
+
+public:
+    explicit BoundedQueue(const std::size_t& capacity) : m_capacity {std::max<std::size_t>(1, capacity)} {}
+
+    // Add the item, return false if the queue is closed
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock {m_mutex};
+        m_not_full.wait(lock, [&]() { return m_closed || m_items.size() < m_capacity; });
+
+        if (m_closed) return false;
+
+        m_items.push_back(std::move(item));
+        m_not_empty.notify_one();
+        return true;
+    }
+
+    // Take the oldest item, return false if the queue is closed and empty
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock {m_mutex};
+        m_not_empty.wait(lock, [&]() { return m_closed || !m_items.empty(); });
+
+        if (m_items.empty()) return false;
+
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        m_not_full.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock {m_mutex};
+        m_closed = true;
+        m_not_empty.notify_all();
+        m_not_full.notify_all();
+    }
+};
+
+
+// The number of threads to use when 0 is requested, i.e., all the hardware threads
+inline std::size_t default_n_threads(const std::size_t& n_threads) {
+    if (n_threads > 0) return n_threads;
+
+    return std::max<std::size_t>(1, std::thread::hardware_concurrency());
+}
+
+
+// Call f(thread_idx, begin, end) on the chunks [begin, end) of [0, n) of size chunk_size, using n_threads threads
+// including the calling thread. The chunks are distributed with work stealing, the order in which
+// they are processed is not specified. If f throws, the first exception is rethrown once all the threads are done.
+template<class F>
+void parallel_for(const std::size_t& n, const std::size_t& chunk_size, std::size_t n_threads, F f) {
+    const std::size_t n_chunks = (n + chunk_size - 1) / chunk_size;
+    n_threads = std::max<std::size_t>(1, std::min(default_n_threads(n_threads), n_chunks));
+
+    WorkStealingRanges ranges {n_chunks, n_threads};
+
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto worker = [&](const std::size_t& thread_idx) {
+        std::size_t chunk;
+
+        try {
+            while (ranges.next(thread_idx, chunk)) {
+                f(thread_idx, chunk * chunk_size, std::min(n, (chunk + 1) * chunk_size));
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock {error_mutex};
+            if (!error) error = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < n_threads; ++i) {
+        threads.emplace_back(worker, i);
+    }
+
+    worker(0);
+
+    for (auto& thread: threads) {
+        thread.join();
+    }
+
+    if (error) std::rethrow_exception(error);
+}
+
+
+
+// Call f(thread_idx, idx, item) on each item given by produce(item), which returns false after the last item.
+// The items are produced on the calling thread and consumed by n_threads other threads as soon as they are
+// produced, with at most capacity items waiting in between, idx is the position of the item in the order
+// of production. If produce or f throws, no item is produced anymore, and the first exception is rethrown
+// once all the threads are done.
+template<class T, class P, class F>
+void parallel_pipeline(std::size_t n_threads, const std::size_t& capacity, P produce, F f) {
+    n_threads = default_n_threads(n_threads);
+
+    BoundedQueue<std::pair<std::size_t, T>> queue {capacity};
+
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto fail = [&]() {
+        {
+            std::lock_guard<std::mutex> lock {error_mutex};
+            if (!error) error = std::current_exception();
+        }
+
+        queue.close();
+    };
+
+    auto worker = [&](const std::size_t& thread_idx) {
+        std::pair<std::size_t, T> item;
+
+        try {
+            while (queue.pop(item)) {
+                f(thread_idx, item.first, item.second);
+            }
+        } catch (...) {
+            fail();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < n_threads; ++i) {
+        threads.emplace_back(worker, i);
+    }
+
+    try {
+        T item;
+        for (std::size_t idx = 0; produce(item); ++idx) {
+            if (!queue.push({idx, std::move(item)})) break;
+        }
+    } catch (...) {
+        fail();
+    }
+
+    queue.close();
+
+    for (auto& thread: threads) {
+        thread.join();
+    }
+
+    if (error) std::rethrow_exception(error);
+}
+
+#endif // PARALLEL_HPP
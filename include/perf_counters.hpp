@@ -0,0 +1,166 @@
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+namespace perf {
+    // The hardware events counted around the phases of the queries
+    enum Event : std::size_t {
+        cycles,
+        instructions,
+        l1d_misses,
+        llc_misses,
+        branch_misses,
+        n_events
+    };
+
+    inline const char* event_name(const std::size_t& event) {
+        static const char* const names[n_events] = {
+                "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"
+        };
+
+        return names[event];
+    }
+
+
+    // The counts of the events, or their differences between two reads
+    struct Sample {
+        std::array<uint64_t, n_events> values;
+
+        Sample() { values.fill(0); }
+
+        Sample& operator+=(const Sample& other) {
+            for (std::size_t e = 0; e < n_events; ++e) {
+                values[e] += other.values[e];
+            }
+
+            return *this;
+        }
+
+        friend Sample operator-(const Sample& end, const Sample& begin) {
+            Sample diff;
+            for (std::size_t e = 0; e < n_events; ++e) {
+                diff.values[e] = end.values[e] - begin.values[e];
+            }
+
+            return diff;
+        }
+    };
+
+
+    // A group of hardware counters of the calling thread, opened with perf_event_open, which counts the events
+    // in user space only. The group is read at once, so all its counters cover the same instructions.
+    // The counters are unavailable if the cycles cannot be counted, e.g., on another OS, in a virtual machine
+    // without PMU, or if perf_event_paranoid forbids it. The other events are only counted if the CPU supports them,
+    // and their counts are 0 otherwise.
+    class Counters {
+    private:
+        // The file descriptor of each event, and its position in the values read from the group, -1 if not counted
+        std::array<int, n_events> m_fds;
+        std::array<int, n_events> m_slots;
+        int m_n_slots = 0;
+        std::string m_error;
+
+#ifdef __linux__
+        static int open_event(const uint32_t& type, const uint64_t& config, const int& group_fd) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = type;
+            attr.config = config;
+            attr.disabled = group_fd == -1 ? 1 : 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+
+            return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0));
+        }
+
+        static uint64_t cache_miss(const uint64_t& cache) {
+            return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        }
+#endif
+
+    public:
+        Counters() {
+            m_fds.fill(-1);
+            m_slots.fill(-1);
+
+#ifdef __linux__
+            const std::array<std::pair<uint32_t, uint64_t>, n_events> events {{
+                    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+                    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+                    {PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_L1D)},
+                    {PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_LL)},
+                    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}
+            }};
+
+            for (std::size_t e = 0; e < n_events; ++e) {
+                m_fds[e] = open_event(events[e].first, events[e].second, e == cycles ? -1 : m_fds[cycles]);
+
+                if (m_fds[e] >= 0) {
+                    m_slots[e] = m_n_slots++;
+                } else if (e == cycles) {
+                    m_error = std::strerror(errno);
+                    return;
+                }
+            }
+
+            ioctl(m_fds[cycles], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#else
+            m_error = "hardware counters are only supported on Linux";
+#endif
+        }
+
+        Counters(const Counters&) = delete;
+
+        Counters& operator=(const Counters&) = delete;
+
+        ~Counters() {
+#ifdef __linux__
+            for (const auto& fd: m_fds) {
+                if (fd >= 0) close(fd);
+            }
+#endif
+        }
+
+        bool available() const { return m_fds[cycles] >= 0; }
+
+        bool counts(const std::size_t& event) const { return m_fds[event] >= 0; }
+
+        // Why the counters are unavailable
+        const std::string& error() const { return m_error; }
+
+        // The counts of the events since the group was opened
+        Sample read() const {
+            Sample sample;
+
+#ifdef __linux__
+            std::array<uint64_t, n_events + 1> buffer;
+
+            if (available() && ::read(m_fds[cycles], buffer.data(), sizeof(buffer)) > 0) {
+                for (std::size_t e = 0; e < n_events; ++e) {
+                    if (m_slots[e] >= 0) sample.values[e] = buffer[1 + m_slots[e]];
+                }
+            }
+#endif
+
+            return sample;
+        }
+    };
+}
+
+#endif // PERF_COUNTERS_HPP
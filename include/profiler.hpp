@@ -0,0 +1,184 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+
+// The profiled sections of the code are known at compile time, so each one is given by a tag, which is the index
+// of its counter. A section only reads the cycle counter twice and updates the counter of the running thread,
+// without any lock, string or map. The counters of a thread are merged into the totals when the thread exits,
+// and the report adds those of the calling thread.
+//
+// The sections are profiled with PROFILE_SCOPE(tag), which expands to nothing unless PROFILE is defined.
+namespace profiler {
+    enum Tag : std::size_t {
+        copy_labels,
+        make_queue,
+        earliest_trip,
+        traverse_routes,
+        scan_footpaths,
+        make_backward_queue,
+        latest_trip,
+        traverse_routes_backward,
+        scan_footpaths_backward,
+        n_tags
+    };
+
+    inline const char* tag_name(const std::size_t& tag) {
+        static const char* const names[n_tags] = {
+                "copy labels",
+                "make queue",
+                "earliest trip",
+                "traverse routes",
+                "scan footpaths",
+                "make backward queue",
+                "latest trip",
+                "traverse routes backward",
+                "scan footpaths backward"
+        };
+
+        return names[tag];
+    }
+
+
+    // The time stamp counter if there is one, otherwise the steady clock in nanoseconds
+    inline uint64_t ticks() {
+        #if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+        #else
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+        #endif
+    }
+
+
+    struct Counter {
+        uint64_t calls = 0;
+        uint64_t ticks = 0;
+    };
+
+    using Counters = std::array<Counter, n_tags>;
+
+
+    // The totals of the threads which have exited, and the time and ticks when the program started,
+    // to convert the ticks to milliseconds
+    struct Totals {
+        std::mutex mutex;
+        Counters counters;
+        std::chrono::steady_clock::time_point start_time {std::chrono::steady_clock::now()};
+        uint64_t start_ticks {ticks()};
+    };
+
+    inline Totals& totals() {
+        static Totals _totals;
+        return _totals;
+    }
+
+
+    class ThreadCounters {
+    public:
+        Counters counters;
+
+        ThreadCounters() { totals(); }
+
+        ~ThreadCounters() {
+            auto& t = totals();
+            std::lock_guard<std::mutex> lock {t.mutex};
+
+            for (std::size_t tag = 0; tag < n_tags; ++tag) {
+                t.counters[tag].calls += counters[tag].calls;
+                t.counters[tag].ticks += counters[tag].ticks;
+            }
+        }
+    };
+
+    inline Counters& thread_counters() {
+        static thread_local ThreadCounters _thread_counters;
+        return _thread_counters.counters;
+    }
+
+
+    template<Tag tag>
+    class Scope {
+    private:
+        uint64_t m_begin;
+
+    public:
+        Scope() : m_begin {ticks()} {}
+
+        Scope(const Scope&) = delete;
+
+        Scope& operator=(const Scope&) = delete;
+
+        ~Scope() {
+            auto& counter = thread_counters()[tag];
+            counter.ticks += ticks() - m_begin;
+            ++counter.calls;
+        }
+    };
+
+
+    // Print the counters of the sections which have been run, the threads still running are not counted
+    inline void report() {
+        auto& t = totals();
+        std::lock_guard<std::mutex> lock {t.mutex};
+
+        Counters counters = t.counters;
+        const auto& own = thread_counters();
+        bool is_empty = true;
+        for (std::size_t tag = 0; tag < n_tags; ++tag) {
+            counters[tag].calls += own[tag].calls;
+            counters[tag].ticks += own[tag].ticks;
+            is_empty = is_empty && counters[tag].calls == 0;
+        }
+
+        if (is_empty) return;
+
+        const double elapsed_ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - t.start_time).count();
+        const double ms_per_tick = elapsed_ms / static_cast<double>(ticks() - t.start_ticks);
+
+        std::cout << std::string(80, '-') << std::endl;
+
+        for (std::size_t tag = 0; tag < n_tags; ++tag) {
+            const auto& counter = counters[tag];
+            if (counter.calls == 0) continue;
+
+            std::cout << "Section " << tag_name(tag) << ":" << std::endl;
+            std::cout << "\tCalled: " << counter.calls << " times" << std::endl;
+            std::cout << "\tTicks per call: " << counter.ticks / counter.calls << std::endl;
+            std::cout << "\tCPU time: " << static_cast<double>(counter.ticks) * ms_per_tick << " ms" << std::endl;
+        }
+
+        std::cout << std::string(80, '-') << std::endl;
+    }
+
+
+    // Reset the counters of the exited threads and of the calling thread
+    inline void clear() {
+        auto& t = totals();
+        std::lock_guard<std::mutex> lock {t.mutex};
+
+        t.counters = Counters();
+        thread_counters() = Counters();
+    }
+}
+
+
+#ifdef PROFILE
+#define PROFILE_SCOPE(tag) profiler::Scope<profiler::tag> profile_scope_##tag
+#else
+#define PROFILE_SCOPE(tag)
+#endif
+
+#endif // PROFILER_HPP
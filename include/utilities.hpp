@@ -60,51 +60,6 @@ public:
 };
 
 
-class Profiler {
-private:
-    using time_log_t = std::unordered_map<std::string, double>;
-    using call_log_t = std::unordered_map<std::string, int>;
-
-    static time_log_t& time_log() {
-        static time_log_t _time_log;
-        return _time_log;
-    }
-
-    static call_log_t& call_log() {
-        static call_log_t _call_log;
-        return _call_log;
-    }
-
-    std::string m_name;
-    Timer m_timer;
-
-public:
-    explicit Profiler(std::string name) : m_name {std::move(name)}, m_timer() {};
-
-    ~Profiler() {
-        time_log()[m_name] += m_timer.elapsed();
-        call_log()[m_name] += 1;
-    }
-
-    static void report() {
-        std::cout << std::string(80, '-') << std::endl;
-
-        for (const auto& kv: time_log()) {
-            std::cout << "Function " << kv.first << ":" << std::endl;
-            std::cout << "\tCalled: " << call_log()[kv.first] << " times" << std::endl;
-            std::cout << "\tCPU time: " << kv.second << Timer().unit() << std::endl;
-        }
-
-        std::cout << std::string(80, '-') << std::endl;
-    }
-
-    static void clear() {
-        time_log().clear();
-        call_log().clear();
-    }
-};
-
-
 class NotImplemented : public std::logic_error {
 public:
     NotImplemented() : std::logic_error("Function not yet implemented") {};
@@ -0,0 +1,232 @@
+#include <algorithm> // std::max
+
+#include "profiler.hpp"
+#include "raptor.hpp"
+#include "search.hpp"
+
+
+// The backward queries run RAPTOR from the target to the source, on the same flat arrays as the forward queries.
+// The label of a stop is the latest time one can leave it and still reach the target by the arrival time,
+// the routes are scanned from their last marked stop to their first stop, the trips are found
+// in the columns of arrival times, and the footpaths and the hubs are taken in the reverse direction.
+
+
+// Build the queue of routes serving the marked stops, then unmark the stops. A route is scanned backward
+// from its latest marked stop, so the queue keeps the positions counted from the end of the routes.
+void Raptor::make_backward_queue() {
+    PROFILE_SCOPE(make_backward_queue);
+
+    queue.clear();
+
+    for (const auto& stop_id: marked_stops.members()) {
+        for (const auto& stop_route: m_timetable->routes_of(m_timetable->stops[stop_id])) {
+            const auto& route = m_timetable->routes[stop_route.route_id];
+
+            queue.add(stop_route.route_id, route.n_stops - 1 - stop_route.stop_idx);
+        }
+    }
+
+    marked_stops.clear();
+}
+
+
+// Find the latest trip among the trips from the position first_trip on that arrives at the stop at position
+// stop_idx no later than t. The trips are given by their position in the route, and the number of trips
+// of the route is returned if there is no such trip.
+size_t Raptor::latest_trip(const Route& route, const size_t& stop_idx, const Time& t, const size_t& first_trip) const {
+    PROFILE_SCOPE(latest_trip);
+
+    const auto& arrivals = m_timetable->arrivals_of_stop(route, stop_idx);
+    const auto value = t.val() - arrivals.shift;
+
+    // Without a trip to improve on, the whole column is searched
+    if (first_trip == 0) {
+        const auto pos = search::first_at_or_after(arrivals.values.begin(), route.n_trips, value + 1);
+        return pos > 0 ? pos - 1 : route.n_trips;
+    }
+
+    // A slightly later departure from a stop usually catches the same trip or one of the next ones,
+    // so we step forward over a few trips before searching the remaining ones
+    size_t pos = first_trip;
+    for (size_t step = 0; step < 4 && pos < route.n_trips; ++step, ++pos) {
+        if (arrivals.values[pos] > value) return pos > first_trip ? pos - 1 : route.n_trips;
+    }
+
+    pos += search::first_at_or_after(arrivals.values.begin() + pos, route.n_trips - pos, value + 1);
+
+    return pos > first_trip ? pos - 1 : route.n_trips;
+}
+
+
+// Traverse each route in the queue backward, and mark the stops whose labels are improved.
+// The labels are pruned by the latest departure time from the source.
+void Raptor::scan_routes_backward(const node_id_t& source_id) {
+    stops_improved = false;
+
+    for (const auto& route_id: queue.routes()) {
+        const auto& route = m_timetable->routes[route_id];
+
+        const auto& route_stops = m_timetable->stops_of(route);
+        size_t trip_pos = route.n_trips;
+        const StopTime* trip_stop_times = nullptr;
+        Time::value_type trip_offset = 0;
+
+        for (size_t i = route_stops.size() - queue.stop_idx(route_id); i-- > 0;) {
+            node_id_t p_i = route_stops[i];
+            Time arr {Time::neg_inf};
+
+            if (trip_stop_times != nullptr) {
+                const Time dep {trip_stop_times[i].dep.val() + trip_offset};
+                arr = Time(trip_stop_times[i].arr.val() + trip_offset);
+
+                // Local and source pruning
+                if (dep > std::max(latest_departure_time[p_i], latest_departure_time[source_id])) {
+                    latest_departure_time.set(p_i, dep);
+                    marked_stops.insert(p_i);
+                    stops_improved = true;
+                }
+            }
+
+            // Check if we can catch a later trip arriving at p_i
+            const auto& prev_label = prev_latest_departure_time[p_i];
+            if (prev_label > Time(Time::neg_inf) && prev_label >= arr) {
+                const auto first_trip = trip_stop_times != nullptr ? trip_pos + 1 : 0;
+                const auto latest_pos = latest_trip(route, i, prev_label, first_trip);
+
+                if (latest_pos < route.n_trips) {
+                    trip_pos = latest_pos;
+                    trip_stop_times = m_timetable->trip_row(route, trip_pos);
+                    trip_offset = m_timetable->trip_offset(route, trip_pos);
+                }
+            }
+        }
+    }
+}
+
+
+// Walk backward to the marked stops, the walks leaving before the latest departure time
+// from the source are pruned. The departure time from the source is read at each test,
+// since it can be set or improved by the walks of this round.
+void Raptor::scan_footpaths_backward(const node_id_t& source_id) {
+    PROFILE_SCOPE(scan_footpaths_backward);
+
+    Time tmp_time;
+
+    const auto n_marked_stops = marked_stops.size();
+    marked_stops_labels.clear();
+    for (const auto& stop_id: marked_stops.members()) {
+        marked_stops_labels.push_back(latest_departure_time[stop_id]);
+    }
+
+    if (!use_hl) {
+        for (size_t i = 0; i < n_marked_stops; ++i) {
+            const auto& stop = m_timetable->stops[marked_stops.members()[i]];
+
+            for (const auto& transfer: m_timetable->backward_transfers_of(stop)) {
+                tmp_time = Time(marked_stops_labels[i].val() - transfer.time.val());
+
+                if (tmp_time > latest_departure_time[transfer.dest]) {
+                    latest_departure_time.set(transfer.dest, tmp_time);
+                    marked_stops.insert(transfer.dest);
+                }
+
+                // The transfers arriving at a stop are also sorted in the increasing order of walking time
+                if (tmp_time < latest_departure_time[source_id]) break;
+            }
+        }
+    } else {
+        // The walks go from the stops having a hub as out-hub to the hub, then to the marked stops
+        // having it as in-hub, so they are scanned from the in-hubs of the marked stops
+        for (size_t i = 0; i < n_marked_stops; ++i) {
+            const auto& stop = m_timetable->stops[marked_stops.members()[i]];
+
+            for (const auto& kv: m_timetable->in_hubs_of(stop)) {
+                tmp_time = Time(marked_stops_labels[i].val() - kv.first.val());
+                if (tmp_time < latest_departure_time[source_id]) break;
+
+                if (tmp_time > tmp_hub_departures[kv.second]) {
+                    tmp_hub_departures.set(kv.second, tmp_time);
+                    improved_hubs.insert(kv.second);
+                }
+            }
+        }
+
+        for (const auto& hub_id: improved_hubs.members()) {
+            const auto hub_label = tmp_hub_departures[hub_id];
+
+            for (const auto& kv: m_timetable->inverse_out_hubs_of(hub_id)) {
+                tmp_time = Time(hub_label.val() - kv.first.val());
+                if (tmp_time < latest_departure_time[source_id]) break;
+
+                if (tmp_time > latest_departure_time[kv.second]) {
+                    latest_departure_time.set(kv.second, tmp_time);
+                    marked_stops.insert(kv.second);
+                }
+            }
+        }
+
+        improved_hubs.clear();
+    }
+}
+
+
+std::vector<Time> Raptor::backward_query(const node_id_t& source_id, const node_id_t& target_id,
+                                         const Time& arrival_time) {
+    std::vector<Time> source_labels;
+
+    latest_departure_time.reset();
+    prev_latest_departure_time.reset();
+    tmp_hub_departures.reset();
+    marked_stops.clear();
+
+    latest_departure_time.set(target_id, arrival_time);
+    prev_latest_departure_time.set(target_id, arrival_time);
+    marked_stops.insert(target_id);
+
+    // As in the forward queries, walking directly from the source to the target is only allowed
+    // with hub labelling, and not in profile queries
+    if (use_hl && !profile) {
+        const auto walking_time = m_timetable->walking_time(source_id, target_id);
+
+        if (walking_time) {
+            latest_departure_time.set(source_id, Time(arrival_time.val() - walking_time.val()));
+        }
+    }
+
+    source_labels.push_back(latest_departure_time[source_id]);
+
+    for (size_t round = 1;; ++round) {
+        for (const auto& stop_id: marked_stops.members()) {
+            prev_latest_departure_time.set(stop_id, latest_departure_time[stop_id]);
+        }
+
+        make_backward_queue();
+
+        {
+            PROFILE_SCOPE(traverse_routes_backward);
+            scan_routes_backward(source_id);
+        }
+
+        source_labels.push_back(latest_departure_time[source_id]);
+
+        // The transfers arriving at the target are scanned in the first round, like the transfers
+        // leaving the source in the forward queries
+        const bool walk_to_target = round == 1 && !profile;
+
+        if (!stops_improved && !walk_to_target) break;
+
+        if (walk_to_target) {
+            marked_stops.insert(target_id);
+        }
+
+        scan_footpaths_backward(source_id);
+
+        if (walk_to_target) {
+            marked_stops.erase(target_id);
+        }
+
+        source_labels.back() = latest_departure_time[source_id];
+    }
+
+    return source_labels;
+}
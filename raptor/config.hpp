@@ -1,11 +1,21 @@
 #ifndef CONFIG_HPP
 #define CONFIG_HPP
 
+#include <cstddef>
 #include <string>
 
 extern std::string name;
 extern bool use_hl;
 extern bool profile;
 extern bool ranked;
+extern bool use_snapshot;
+extern bool verify_snapshot;
+extern std::size_t n_threads;
+extern int range_window;
+extern bool record_journeys;
+extern bool multi_criteria;
+extern bool arrive_by;
+extern bool record_stats;
+extern bool record_perf;
 
 #endif // CONFIG_HPP
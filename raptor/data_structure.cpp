@@ -1,12 +1,26 @@
 #include <algorithm>
 #include <cmath>
+#include <stdexcept>
+#include <tuple>
 
 #include "data_structure.hpp"
 #include "csv.h"
-#include "gzstream.h"
+#include "gz_source.hpp"
+#include "parallel.hpp"
 
 
 extern const trip_id_t NULL_TRIP = -1;
+extern const node_id_t NULL_STOP = std::numeric_limits<node_id_t>::max();
+
+
+namespace {
+    // A row of the stop times file, the stops are only kept while parsing since the timetable
+    // stores them once per route in its stop pattern
+    struct StopEvent {
+        node_id_t stop_id;
+        StopTime stop_time;
+    };
+}
 
 
 void Timetable::parse_data() {
@@ -16,25 +30,58 @@ void Timetable::parse_data() {
 
     parse_trips();
     parse_stop_routes();
+    parse_stop_times();
     if (!use_hl) {
         parse_transfers();
     } else {
         parse_hubs();
     }
-    parse_stop_times();
+    renumber();
 
     std::cout << "Complete parsing the data." << std::endl;
     std::cout << "Time elapsed: " << timer.elapsed() << timer.unit() << std::endl;
 }
 
 
+// Group the items by their key in [0, n_keys) with a stable counting sort in linear time,
+// and return the offsets of the groups, i.e., after sorting, the items with the key k
+// are in the range [offsets[k], offsets[k + 1])
+template<class T, class KeyFunc>
+std::vector<size_t> group_by_key(std::vector<T>& items, const size_t& n_keys, KeyFunc key) {
+    std::vector<size_t> offsets(n_keys + 1, 0);
+
+    for (const auto& item: items) {
+        ++offsets[key(item) + 1];
+    }
+
+    for (size_t k = 0; k < n_keys; ++k) {
+        offsets[k + 1] += offsets[k];
+    }
+
+    std::vector<size_t> next {offsets.begin(), offsets.end() - 1};
+    std::vector<size_t> order(items.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        order[next[key(items[i])]++] = i;
+    }
+
+    std::vector<T> sorted;
+    sorted.reserve(items.size());
+    for (const auto& i: order) {
+        sorted.push_back(items[i]);
+    }
+    items.swap(sorted);
+
+    return offsets;
+}
+
+
 void Timetable::parse_trips() {
-    igzstream trips_file_stream {(path + "trips.csv.gz").c_str()};
-    io::CSVReader<2> trips_file_reader {"trips.csv", trips_file_stream};
+    io::CSVReader<2> trips_file_reader {"trips.csv", open_gz(path + "trips.csv.gz")};
     trips_file_reader.read_header(io::ignore_no_column, "route_id", "trip_id");
 
     route_id_t route_id;
     trip_id_t trip_id;
+    std::vector<std::pair<route_id_t, trip_id_t>> rows;
 
     while (trips_file_reader.read_row(route_id, trip_id)) {
         // Add a new route if we encounter a new id
@@ -43,22 +90,38 @@ void Timetable::parse_trips() {
             routes.back().id = static_cast<route_id_t>(routes.size() - 1);
         }
 
-        // Map the trip to its position in routes and trips, this map is used
-        // to quickly add the stop times later in the parse_stop_times function
         if (static_cast<size_t>(trip_id) >= trip_positions.size()) {
             trip_positions.resize(static_cast<size_t>(trip_id + 1));
         }
-        trip_positions[trip_id] = {route_id, routes[route_id].trips.size()};
 
-        routes[route_id].trips.push_back(trip_id);
-        routes[route_id].stop_times_by_trips.emplace_back();
+        rows.emplace_back(route_id, trip_id);
+    }
+
+    // The trips of a route are contiguous in route_trips, in the same order as in the file
+    auto offsets = group_by_key(rows, routes.size(),
+                                [](const std::pair<route_id_t, trip_id_t>& row) { return row.first; });
+
+    for (auto& route: routes) {
+        route.trips_idx = offsets[route.id];
+        route.n_trips = offsets[route.id + 1] - offsets[route.id];
+    }
+
+    route_trips.reserve(rows.size());
+    for (const auto& row: rows) {
+        std::tie(route_id, trip_id) = row;
+
+        // Map the trip to its position in routes and trips, this map is used
+        // to quickly add the stop times later in the parse_stop_times function
+        trip_positions[trip_id] = {route_id, route_trips.size() - routes[route_id].trips_idx};
+        route_trips.push_back(trip_id);
     }
 }
 
 
+// Create the stops, the routes serving them are given later by the stop patterns of the routes,
+// together with the positions of the stops in the routes
 void Timetable::parse_stop_routes() {
-    igzstream stop_routes_file_stream {(path + "stop_routes.csv.gz").c_str()};
-    io::CSVReader<2> stop_routes_reader {"stop_routes.csv", stop_routes_file_stream};
+    io::CSVReader<2> stop_routes_reader {"stop_routes.csv", open_gz(path + "stop_routes.csv.gz")};
     stop_routes_reader.read_header(io::ignore_no_column, "stop_id", "route_id");
 
     node_id_t stop_id;
@@ -71,8 +134,6 @@ void Timetable::parse_stop_routes() {
             stops.emplace_back();
             stops.back().id = static_cast<node_id_t>(stops.size() - 1);
         }
-
-        stops[stop_id].routes.push_back(route_id);
     }
 
     max_stop_id = max_node_id = stops.back().id;
@@ -80,134 +141,357 @@ void Timetable::parse_stop_routes() {
 
 
 void Timetable::parse_transfers() {
-    igzstream transfers_file_stream {(path + "transfers.csv.gz").c_str()};
-    io::CSVReader<3> transfers_reader {"transfers.csv", transfers_file_stream};
+    io::CSVReader<3> transfers_reader {"transfers.csv", open_gz(path + "transfers.csv.gz")};
     transfers_reader.read_header(io::ignore_no_column, "from_stop_id", "to_stop_id", "min_transfer_time");
 
     node_id_t from;
     node_id_t to;
     Time::value_type time;
+    std::vector<std::pair<node_id_t, Transfer>> rows;
+    std::vector<std::pair<node_id_t, Transfer>> backward_rows;
 
     while (transfers_reader.read_row(from, to, time)) {
-        if (stops[from].is_valid() && stops[to].is_valid()) {
-            stops[from].transfers.emplace_back(to, time);
-            stops[to].backward_transfers.emplace_back(from, time);
+        if (from < stops.size() && to < stops.size() && stops[from].is_valid() && stops[to].is_valid()) {
+            rows.emplace_back(from, Transfer {to, time});
+            backward_rows.emplace_back(to, Transfer {from, time});
         }
 
         max_node_id = std::max(max_node_id, static_cast<std::size_t>(from));
         max_node_id = std::max(max_node_id, static_cast<std::size_t>(to));
     }
 
+    auto by_stop = [](const std::pair<node_id_t, Transfer>& row) { return row.first; };
+    auto offsets = group_by_key(rows, stops.size(), by_stop);
+    auto backward_offsets = group_by_key(backward_rows, stops.size(), by_stop);
+
+    for (const auto& row: rows) {
+        transfers.push_back(row.second);
+    }
+
+    for (const auto& row: backward_rows) {
+        backward_transfers.push_back(row.second);
+    }
+
     for (auto& stop: stops) {
-        std::sort(stop.transfers.begin(), stop.transfers.end());
+        stop.transfers_idx = offsets[stop.id];
+        stop.n_transfers = offsets[stop.id + 1] - offsets[stop.id];
+        stop.backward_transfers_idx = backward_offsets[stop.id];
+        stop.n_backward_transfers = backward_offsets[stop.id + 1] - backward_offsets[stop.id];
+
+        std::sort(transfers.begin() + stop.transfers_idx,
+                  transfers.begin() + stop.transfers_idx + stop.n_transfers);
+        std::sort(backward_transfers.begin() + stop.backward_transfers_idx,
+                  backward_transfers.begin() + stop.backward_transfers_idx + stop.n_backward_transfers);
     }
 }
 
 
 void Timetable::parse_hubs() {
-    inverse_in_hubs.resize(max_node_id);
-
-    igzstream in_hubs_file_stream {(path + "in_hubs.gr.gz").c_str()};
-    io::CSVReader<3, io::trim_chars<>, io::no_quote_escape<' '>> in_hubs_reader {"in_hubs.gr", in_hubs_file_stream};
+    io::CSVReader<3, io::trim_chars<>, io::no_quote_escape<' '>> in_hubs_reader {"in_hubs.gr",
+        open_gz(path + "in_hubs.gr.gz")};
     in_hubs_reader.set_header("node_id", "stop_id", "distance");
 
     node_id_t node_id;
     node_id_t stop_id;
     distance_t distance;
 
+    // The rows of both files, indexed by stop
+    std::vector<std::pair<node_id_t, hub_t>> in_hubs_rows;
+    std::vector<std::pair<node_id_t, hub_t>> out_hubs_rows;
+
     while (in_hubs_reader.read_row(node_id, stop_id, distance)) {
-        auto time = distance_to_time(distance);
+        max_node_id = std::max(max_node_id, static_cast<std::size_t>(node_id));
+
+        in_hubs_rows.emplace_back(stop_id, hub_t {distance_to_time(distance), node_id});
+    }
+
+    io::CSVReader<3, io::trim_chars<>, io::no_quote_escape<' '>> out_hubs_reader {"out_hubs.gr",
+        open_gz(path + "out_hubs.gr.gz")};
+    out_hubs_reader.set_header("stop_id", "node_id", "distance");
+
+    while (out_hubs_reader.read_row(stop_id, node_id, distance)) {
+        max_node_id = std::max(max_node_id, static_cast<std::size_t>(node_id));
 
-        if (node_id > max_node_id) {
-            max_node_id = node_id;
-            inverse_in_hubs.resize(max_node_id + 1);
+        out_hubs_rows.emplace_back(stop_id, hub_t {distance_to_time(distance), node_id});
+    }
+
+    // A walk between two stops goes through a node which is an out-hub of the first stop and an in-hub
+    // of the second one, so the other nodes are dropped. The remaining hubs are numbered densely
+    // in the increasing order of their node id, so that the labels of the hubs can be stored in an array.
+    std::vector<bool> is_in_hub(max_node_id + 1), is_out_hub(max_node_id + 1);
+    for (const auto& row: in_hubs_rows) is_in_hub[row.second.second] = true;
+    for (const auto& row: out_hubs_rows) is_out_hub[row.second.second] = true;
+
+    std::vector<node_id_t> hub_ids(max_node_id + 1, NULL_STOP);
+    n_hubs = 0;
+    for (size_t v = 0; v <= max_node_id; ++v) {
+        if (is_in_hub[v] && is_out_hub[v]) hub_ids[v] = static_cast<node_id_t>(n_hubs++);
+    }
+
+    // The rows of the inverse links are indexed by hub
+    std::vector<std::pair<node_id_t, hub_t>> inverse_in_hubs_rows;
+    std::vector<std::pair<node_id_t, hub_t>> inverse_out_hubs_rows;
+
+    auto remap = [&](std::vector<std::pair<node_id_t, hub_t>>& rows,
+                     std::vector<std::pair<node_id_t, hub_t>>& inverse_rows) {
+        rows.erase(std::remove_if(rows.begin(), rows.end(), [&](const std::pair<node_id_t, hub_t>& row) {
+            return hub_ids[row.second.second] == NULL_STOP;
+        }), rows.end());
+
+        inverse_rows.reserve(rows.size());
+        for (auto& row: rows) {
+            row.second.second = hub_ids[row.second.second];
+            inverse_rows.emplace_back(row.second.second, hub_t {row.second.first, row.first});
         }
+    };
+
+    remap(in_hubs_rows, inverse_in_hubs_rows);
+    remap(out_hubs_rows, inverse_out_hubs_rows);
+
+    // Store the rows contiguously by key, each slice is sorted by walking time
+    auto flatten = [](std::vector<std::pair<node_id_t, hub_t>>& rows, const size_t& n_keys,
+                      FlatArray<hub_t>& hubs) {
+        auto offsets = group_by_key(rows, n_keys,
+                                    [](const std::pair<node_id_t, hub_t>& row) { return row.first; });
+
+        hubs.reserve(rows.size());
+        for (const auto& row: rows) {
+            hubs.push_back(row.second);
+        }
+
+        for (size_t k = 0; k < n_keys; ++k) {
+            std::sort(hubs.begin() + offsets[k], hubs.begin() + offsets[k + 1]);
+        }
+
+        return offsets;
+    };
 
-        stops[stop_id].in_hubs.emplace_back(time, node_id);
-        inverse_in_hubs[node_id].emplace_back(time, stop_id);
+    auto in_hubs_offsets = flatten(in_hubs_rows, stops.size(), in_hubs);
+    auto out_hubs_offsets = flatten(out_hubs_rows, stops.size(), out_hubs);
+
+    for (auto& stop: stops) {
+        stop.in_hubs_idx = in_hubs_offsets[stop.id];
+        stop.n_in_hubs = in_hubs_offsets[stop.id + 1] - in_hubs_offsets[stop.id];
+        stop.out_hubs_idx = out_hubs_offsets[stop.id];
+        stop.n_out_hubs = out_hubs_offsets[stop.id + 1] - out_hubs_offsets[stop.id];
     }
 
-    inverse_out_hubs.resize(max_node_id);
+    inverse_in_hubs_idx = flatten(inverse_in_hubs_rows, n_hubs, inverse_in_hubs);
+    inverse_out_hubs_idx = flatten(inverse_out_hubs_rows, n_hubs, inverse_out_hubs);
+}
 
-    igzstream out_hubs_file_stream {(path + "out_hubs.gr.gz").c_str()};
-    io::CSVReader<3, io::trim_chars<>, io::no_quote_escape<' '>> out_hubs_reader {"out_hubs.gr", out_hubs_file_stream};
-    out_hubs_reader.set_header("stop_id", "node_id", "distance");
 
-    while (out_hubs_reader.read_row(stop_id, node_id, distance)) {
-        auto time = distance_to_time(distance);
+void Timetable::parse_stop_times() {
+    // The file is decompressed by this thread, and each chunk is parsed by another thread as soon as it is
+    // decompressed. The rows of each thread are kept by chunk, to be put back in the order of the file.
+    using Rows = std::vector<std::pair<trip_id_t, StopEvent>>;
+    static const size_t chunk_bytes = 1 << 23;
+    GzChunkReader reader {path + "stop_times.csv.gz", chunk_bytes};
+
+    const auto n_parsers = default_n_threads(n_threads);
+    std::vector<std::vector<std::pair<size_t, Rows>>> thread_rows(n_parsers);
+
+    auto next_chunk = [&](std::string& chunk) { return reader.next(chunk); };
+
+    parallel_pipeline<std::string>(n_parsers, 2 * n_parsers, next_chunk,
+                                   [&](const size_t& thread_idx, const size_t& c, const std::string& chunk) {
+        io::CSVReader<4> stop_times_reader {"stop_times.csv", chunk.data(), chunk.data() + chunk.size()};
+        stop_times_reader.read_header(io::ignore_extra_column, "trip_id", "arrival_time", "departure_time", "stop_id");
+
+        trip_id_t trip_id;
+        Time::value_type arr, dep;
+        node_id_t stop_id;
+        Rows rows;
+
+        while (stop_times_reader.read_row(trip_id, arr, dep, stop_id)) {
+            if (trip_id < 0 || static_cast<size_t>(trip_id) >= trip_positions.size()) {
+                throw std::runtime_error("Unknown trip " + std::to_string(trip_id) + " in the stop times");
+            }
 
-        if (node_id > max_node_id) {
-            max_node_id = node_id;
-            inverse_out_hubs.resize(max_node_id + 1);
+            if (stop_id > max_stop_id) {
+                throw std::runtime_error("Unknown stop " + std::to_string(stop_id) + " in the stop times");
+            }
+
+            rows.emplace_back(trip_id, StopEvent {stop_id, StopTime {arr, dep}});
         }
 
-        stops[stop_id].out_hubs.emplace_back(time, node_id);
-        inverse_out_hubs[node_id].emplace_back(time, stop_id);
+        thread_rows[thread_idx].emplace_back(c, std::move(rows));
+    });
+
+    std::vector<Rows> chunk_rows;
+    for (auto& rows_by_chunk: thread_rows) {
+        for (auto& kv: rows_by_chunk) {
+            if (kv.first >= chunk_rows.size()) chunk_rows.resize(kv.first + 1);
+            chunk_rows[kv.first] = std::move(kv.second);
+        }
     }
 
-    for (auto& stop: stops) {
-        std::sort(stop.in_hubs.begin(), stop.in_hubs.end());
-        std::sort(stop.out_hubs.begin(), stop.out_hubs.end());
+    // Group the stop events by trip with a counting sort, keeping the order of the file within each trip
+    std::vector<size_t> trip_events_idx(trip_positions.size() + 1, 0);
+    for (const auto& rows: chunk_rows) {
+        for (const auto& row: rows) {
+            ++trip_events_idx[row.first + 1];
+        }
     }
 
-    for (auto& item: inverse_in_hubs) {
-        std::sort(item.begin(), item.end());
+    for (size_t trip_id = 0; trip_id < trip_positions.size(); ++trip_id) {
+        trip_events_idx[trip_id + 1] += trip_events_idx[trip_id];
     }
 
-    for (auto& item: inverse_out_hubs) {
-        std::sort(item.begin(), item.end());
+    std::vector<StopEvent> trip_stop_times(trip_events_idx.back());
+    {
+        std::vector<size_t> next {trip_events_idx.begin(), trip_events_idx.end() - 1};
+
+        for (auto& rows: chunk_rows) {
+            for (const auto& row: rows) {
+                trip_stop_times[next[row.first]++] = row.second;
+            }
+
+            std::vector<std::pair<trip_id_t, StopEvent>>().swap(rows);
+        }
     }
-}
 
+    auto n_trip_stop_times = [&](const trip_id_t& trip_id) {
+        return trip_events_idx[trip_id + 1] - trip_events_idx[trip_id];
+    };
 
-void Timetable::parse_stop_times() {
-    igzstream stop_times_file_stream {(path + "stop_times.csv.gz").c_str()};
-    io::CSVReader<4> stop_times_reader {"stop_times.csv", stop_times_file_stream};
-    stop_times_reader.read_header(io::ignore_extra_column, "trip_id", "arrival_time", "departure_time", "stop_id");
+    // The stop pattern of a route is given by its first trip. The route is periodic if the times of each trip
+    // are those of the first trip shifted by the offset of the trip, and if the offsets do not decrease,
+    // so that the columns given by the offsets are sorted. A route with a single trip is not periodic, since
+    // there is nothing to shift. The other routes have no offset.
+    trip_offsets.resize(route_trips.size());
 
-    trip_id_t trip_id;
-    Time::value_type arr, dep;
-    node_id_t stop_id;
+    parallel_for(routes.size(), 16, n_threads, [&](const size_t&, const size_t& begin, const size_t& end) {
+        for (size_t route_id = begin; route_id < end; ++route_id) {
+            auto& route = routes[route_id];
+            route.n_stops = route.n_trips > 0 ? n_trip_stop_times(route_trips[route.trips_idx]) : 0;
+            route.is_periodic = route.n_trips > 1 && route.n_stops > 0;
 
-    while (stop_times_reader.read_row(trip_id, arr, dep, stop_id)) {
-        trip_pos_t trip_pos = trip_positions[trip_id];
-        route_id_t route_id = trip_pos.first;
-        size_t pos = trip_pos.second;
+            const auto first_trip_idx = route.n_stops > 0 ? trip_events_idx[route_trips[route.trips_idx]] : 0;
 
-        routes[route_id].stop_times_by_trips[pos].emplace_back(stop_id, arr, dep);
+            for (size_t pos = 0; route.is_periodic && pos < route.n_trips; ++pos) {
+                const auto& trip_id = route_trips[route.trips_idx + pos];
+                const auto trip_idx = trip_events_idx[trip_id];
+                if (n_trip_stop_times(trip_id) != route.n_stops) break;
 
-        // Create the stop sequence of the route corresponding to trip_id,
-        // we add stop_id to the stop sequence only once by checking if
-        // trip_id is the first trip of its route
-        if (trip_id == routes[route_id].trips[0]) {
-            auto& stops = routes[route_id].stops;
-            auto& route_stop_positions = routes[route_id].stop_positions;
-            stops.push_back(stop_id);
+                const auto offset = trip_stop_times[trip_idx].stop_time.arr.val() -
+                                    trip_stop_times[first_trip_idx].stop_time.arr.val();
+                route.is_periodic = pos == 0 || offset >= trip_offsets[route.trips_idx + pos - 1];
 
-            // Map the stop_id to its index in the stop sequence
-            if (stop_id >= route_stop_positions.size()) {
-                route_stop_positions.resize(stop_id + 1);
+                for (size_t i = 0; route.is_periodic && i < route.n_stops; ++i) {
+                    const auto& stop_time = trip_stop_times[trip_idx + i].stop_time;
+                    const auto& first_stop_time = trip_stop_times[first_trip_idx + i].stop_time;
+
+                    route.is_periodic = stop_time.arr.val() == first_stop_time.arr.val() + offset &&
+                                        stop_time.dep.val() == first_stop_time.dep.val() + offset;
+                }
+
+                trip_offsets[route.trips_idx + pos] = offset;
             }
 
-            // Only store the position of the first appearance of the stop
-            if (std::count(stops.begin(), stops.end(), stop_id) == 1) {
-                route_stop_positions[stop_id] = stops.size() - 1;
+            if (!route.is_periodic) {
+                std::fill_n(trip_offsets.begin() + route.trips_idx, route.n_trips, 0);
             }
         }
-    }
+    });
 
-    // Create the stop_times_by_stops for each route, which is the transpose of stop_times_by_trips
+    // This gives the size of the stop events table of the route, and hence its position in the flat arrays
+    size_t n_route_stops = 0;
+    size_t n_stop_times = 0;
+    size_t n_column_times = 0;
     for (auto& route: routes) {
-        const auto& n_stops = route.stops.size();
-        route.stop_times_by_stops.resize(n_stops);
+        route.stops_idx = n_route_stops;
+        route.stop_times_idx = n_stop_times;
+        route.columns_idx = n_column_times;
 
-        // Iterate over each stop in the pattern of the route only once
-        for (size_t i = 0; i < n_stops; ++i) {
-            for (const auto& trip_stop_times: route.stop_times_by_trips) {
-                route.stop_times_by_stops[i].push_back(trip_stop_times[i]);
+        n_route_stops += route.n_stops;
+        n_stop_times += route.n_stops * route.n_rows();
+        n_column_times += route.is_periodic ? 0 : route.n_stops * route.n_trips;
+    }
+
+    route_stops.resize(n_route_stops);
+    stop_times.resize(n_stop_times);
+    departures.resize(n_column_times);
+    arrivals.resize(n_column_times);
+
+    // The tables of the routes are disjoint slices of the flat arrays, so they are filled in parallel
+    parallel_for(routes.size(), 16, n_threads, [&](const size_t&, const size_t& begin, const size_t& end) {
+        for (size_t route_id = begin; route_id < end; ++route_id) {
+            const auto& route = routes[route_id];
+            if (route.n_stops == 0) continue;
+
+            // Create the stop sequence of the route from its first trip
+            const auto first_trip_idx = trip_events_idx[route_trips[route.trips_idx]];
+            for (size_t i = 0; i < route.n_stops; ++i) {
+                route_stops[route.stops_idx + i] = trip_stop_times[first_trip_idx + i].stop_id;
             }
+
+            // The stop events only keep their times, so all the trips must follow the stop pattern
+            for (size_t pos = 0; pos < route.n_trips; ++pos) {
+                const auto& trip_id = route_trips[route.trips_idx + pos];
+                const auto trip_idx = trip_events_idx[trip_id];
+
+                bool follows_pattern = n_trip_stop_times(trip_id) == route.n_stops;
+                for (size_t i = 0; follows_pattern && i < route.n_stops; ++i) {
+                    follows_pattern = trip_stop_times[trip_idx + i].stop_id == route_stops[route.stops_idx + i];
+                }
+
+                if (!follows_pattern) {
+                    throw std::runtime_error("Trip " + std::to_string(trip_id) +
+                                             " does not follow the stop pattern of route " + std::to_string(route.id));
+                }
+
+                if (pos >= route.n_rows()) continue;
+
+                auto* row = stop_times.begin() + route.stop_times_idx + pos * route.n_stops;
+                for (size_t i = 0; i < route.n_stops; ++i) {
+                    row[i] = trip_stop_times[trip_idx + i].stop_time;
+                }
+            }
+
+            if (route.is_periodic) continue;
+
+            // The departures and arrivals tables of the route are the transpose of its stop_times table
+            for (size_t pos = 0; pos < route.n_trips; ++pos) {
+                const auto* row = trip_row(route, pos);
+
+                for (size_t i = 0; i < route.n_stops; ++i) {
+                    departures[route.columns_idx + i * route.n_trips + pos] = row[i].dep.val();
+                    arrivals[route.columns_idx + i * route.n_trips + pos] = row[i].arr.val();
+                }
+            }
+        }
+    });
+
+    build_stop_routes();
+}
+
+
+// The routes serving each stop are contiguous in stop_routes, a route appears once per visit of the stop
+void Timetable::build_stop_routes() {
+    std::vector<std::pair<node_id_t, StopRoute>> rows;
+    rows.reserve(route_stops.size());
+    for (const auto& route: routes) {
+        for (size_t i = 0; i < route.n_stops; ++i) {
+            rows.emplace_back(route_stops[route.stops_idx + i], StopRoute {route.id, static_cast<uint32_t>(i)});
         }
     }
+
+    auto offsets = group_by_key(rows, stops.size(),
+                                [](const std::pair<node_id_t, StopRoute>& row) { return row.first; });
+
+    for (auto& stop: stops) {
+        stop.routes_idx = offsets[stop.id];
+        stop.n_routes = offsets[stop.id + 1] - offsets[stop.id];
+    }
+
+    std::vector<StopRoute> stop_routes_by_stop;
+    stop_routes_by_stop.reserve(rows.size());
+    for (const auto& row: rows) {
+        stop_routes_by_stop.push_back(row.second);
+    }
+
+    stop_routes = std::move(stop_routes_by_stop);
 }
 
 
@@ -219,41 +503,38 @@ void Timetable::summary() const {
 
     std::cout << routes.size() << " routes" << std::endl;
 
-    int count_trips = 0;
-    int count_stop_times = 0;
-    for (const auto& route: routes) {
-        count_trips += route.trips.size();
-        for (const auto& stop_time: route.stop_times_by_trips) {
-            count_stop_times += stop_time.size();
-        }
-    }
-
-    std::cout << count_trips << " trips" << std::endl;
+    std::cout << route_trips.size() << " trips" << std::endl;
 
     // Count the number of stops with at least one route using it
     int count_stops = 0;
     int count_hubs = 0;
-    int count_transfers = 0;
     for (const auto& stop: stops) {
         if (stop.is_valid()) {
             count_stops += 1;
         }
 
-        count_transfers += stop.transfers.size();
-        count_hubs += stop.in_hubs.size();
-        count_hubs += stop.out_hubs.size();
+        count_hubs += stop.n_in_hubs;
+        count_hubs += stop.n_out_hubs;
     }
     std::cout << count_stops << " stops" << std::endl;
 
     if (!use_hl) {
-        std::cout << count_transfers << " transfers" << std::endl;
+        std::cout << transfers.size() << " transfers" << std::endl;
     } else {
         std::cout.setf(std::ios::fixed, std::ios::floatfield);
         std::cout.precision(3);
         std::cout << count_hubs / static_cast<double>(count_stops) << " hubs in average" << std::endl;
     }
 
-    std::cout << count_stop_times << " events" << std::endl;
+    // The periodic routes only store the events of their first trip
+    size_t count_events = 0;
+    size_t count_periodic = 0;
+    for (const auto& route: routes) {
+        count_events += route.n_stops * route.n_trips;
+        count_periodic += route.is_periodic;
+    }
+    std::cout << count_events << " events" << std::endl;
+    std::cout << count_periodic << " periodic routes" << std::endl;
 
     std::cout << std::string(80, '-') << std::endl;
 }
@@ -266,7 +547,7 @@ Time Timetable::walking_time(const node_id_t& source_id, const node_id_t& target
     Time arrival_time {};
 
     // Find the earliest time to get to the out hubs of the source
-    for (const auto& kv: stops[source_id].out_hubs) {
+    for (const auto& kv: out_hubs_of(stops[source_id])) {
         auto walking_time = kv.first;
         auto hub_id = kv.second;
 
@@ -274,7 +555,7 @@ Time Timetable::walking_time(const node_id_t& source_id, const node_id_t& target
     }
 
     // Propagate the time from the hubs to the target
-    for (const auto& kv: stops[target_id].in_hubs) {
+    for (const auto& kv: in_hubs_of(stops[target_id])) {
         auto walking_time = kv.first;
         auto hub_id = kv.second;
 
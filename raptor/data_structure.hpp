@@ -1,14 +1,18 @@
 #ifndef DATA_STRUCTURE_HPP
 #define DATA_STRUCTURE_HPP
 
+#include <algorithm> // std::lower_bound
+#include <cstddef>
 #include <cstdint>
 #include <iostream>
 #include <limits> // std::numeric_limits
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "config.hpp"
+#include "flat_array.hpp"
 #include "utilities.hpp"
 
 
@@ -19,6 +23,10 @@ using trip_pos_t = std::pair<route_id_t, size_t>;
 using distance_t = uint32_t;
 
 extern const trip_id_t NULL_TRIP;
+extern const node_id_t NULL_STOP;
+
+
+class MappedFile;
 
 
 class Time {
@@ -77,8 +85,9 @@ public:
 };
 
 
-using hubs_t = std::vector<std::pair<Time, node_id_t>>;
-using inverse_hubs_t = std::vector<hubs_t>;
+// A link between a stop and a hub, together with the walking time between them. The hubs are numbered
+// from 0 to Timetable::n_hubs - 1, independently of the ids of the nodes of the road network.
+using hub_t = std::pair<Time, node_id_t>;
 
 
 struct Transfer {
@@ -93,34 +102,101 @@ struct Transfer {
 };
 
 
+// A view over a contiguous slice of one of the flat arrays of the timetable
+template<class T>
+class Range {
+private:
+    const T* m_begin;
+    const T* m_end;
+
+public:
+    Range(const T* begin, const T* end) : m_begin {begin}, m_end {end} {};
+
+    Range(const T* begin, size_t size) : m_begin {begin}, m_end {begin + size} {};
+
+    const T* begin() const { return m_begin; }
+
+    const T* end() const { return m_end; }
+
+    size_t size() const { return static_cast<size_t>(m_end - m_begin); }
+
+    bool empty() const { return m_begin == m_end; }
+
+    const T& operator[](const size_t& i) const { return m_begin[i]; }
+};
+
+
+// A route serving a stop, together with the position of the stop in the stop pattern of the route.
+// A route visiting the stop several times, i.e., a loop, serves it once for each visit.
+struct StopRoute {
+    route_id_t route_id;
+    uint32_t stop_idx;
+};
+
+
+// The routes, transfers, and hubs of a stop are stored in the flat arrays
+// Timetable::stop_routes, Timetable::transfers, Timetable::backward_transfers,
+// Timetable::in_hubs, and Timetable::out_hubs, a stop only keeps the position
+// of its slice in each of them
 struct Stop {
     node_id_t id;
-    std::vector<route_id_t> routes;
-    std::vector<Transfer> transfers;
-    std::vector<Transfer> backward_transfers;
-    hubs_t in_hubs;
-    hubs_t out_hubs;
-
-    bool is_valid() const { return !routes.empty(); }
+    size_t routes_idx = 0;
+    size_t n_routes = 0;
+    size_t transfers_idx = 0;
+    size_t n_transfers = 0;
+    size_t backward_transfers_idx = 0;
+    size_t n_backward_transfers = 0;
+    size_t in_hubs_idx = 0;
+    size_t n_in_hubs = 0;
+    size_t out_hubs_idx = 0;
+    size_t n_out_hubs = 0;
+
+    bool is_valid() const { return n_routes > 0; }
 };
 
 
+// A stop event of a trip, its stop is given by the stop pattern of the route
 struct StopTime {
-    node_id_t stop_id;
     Time arr;
     Time dep;
 
-    StopTime(node_id_t s, Time::value_type a, Time::value_type d) : stop_id {s}, arr {a}, dep {d} {};
+    StopTime() : arr {}, dep {} {};
+
+    StopTime(Time::value_type a, Time::value_type d) : arr {a}, dep {d} {};
 };
 
 
+// The stop pattern, the trips, and the stop events of a route are stored in the flat arrays
+// of the timetable, a route only keeps the position of its slice in each of them.
+// The stop events of a route form a n_trips x n_stops table, which is stored row by row (trip-major)
+// in Timetable::stop_times, to scan the trips. Its departure (resp. arrival) times are also stored
+// column by column (stop-major) in Timetable::departures (resp. Timetable::arrivals) from columns_idx,
+// so that the search of the earliest trip leaving a stop, or of the latest trip arriving at a stop
+// in the backward queries, reads a contiguous column of integers.
+// The trips of a periodic route are copies of its first trip shifted by a constant offset, e.g., a metro line
+// running every few minutes. Such a route only stores the row of its first trip, and its columns are given
+// by the offsets of the trips in Timetable::trip_offsets, which is aligned with the trips of the routes.
 struct Route {
     route_id_t id;
-    std::vector<trip_id_t> trips;
-    std::vector<node_id_t> stops;
-    std::vector<std::vector<StopTime>> stop_times_by_trips;
-    std::vector<std::vector<StopTime>> stop_times_by_stops;
-    std::vector<size_t> stop_positions;
+    bool is_periodic = false;
+    size_t n_stops = 0;
+    size_t n_trips = 0;
+    size_t stops_idx = 0;
+    size_t trips_idx = 0;
+    size_t stop_times_idx = 0;
+    size_t columns_idx = 0;
+
+    // The number of rows of stop events stored for the route
+    size_t n_rows() const { return is_periodic ? 1 : n_trips; }
+};
+
+
+// The times of all the trips of a route at one of its stops, the time of the trip at position i is
+// values[i] + shift. The values of a periodic route are the offsets of its trips, and the shift is the time
+// of its first trip at the stop, otherwise the values are the times themselves.
+struct TimeColumn {
+    Range<Time::value_type> values;
+    Time::value_type shift;
 };
 
 
@@ -138,21 +214,181 @@ private:
 
     void parse_stop_times();
 
+    void build_stop_routes();
+
+    void renumber();
+
+    void check_layout() const;
+
+    // The memory-mapped snapshot file that the flat arrays point into, if any
+    std::shared_ptr<const MappedFile> m_snapshot;
+
 public:
     std::string path;
     std::size_t max_stop_id = 0;
     std::size_t max_node_id = 0;
-    std::vector<Route> routes;
-    std::vector<Stop> stops;
-    std::vector<trip_pos_t> trip_positions;
-    inverse_hubs_t inverse_in_hubs;
-    inverse_hubs_t inverse_out_hubs;
+    std::size_t n_hubs = 0;
+    FlatArray<Route> routes;
+    FlatArray<Stop> stops;
+    FlatArray<node_id_t> route_stops;
+    FlatArray<trip_id_t> route_trips;
+    FlatArray<Time::value_type> trip_offsets;
+    FlatArray<StopTime> stop_times;
+    FlatArray<Time::value_type> departures;
+    FlatArray<Time::value_type> arrivals;
+    FlatArray<StopRoute> stop_routes;
+    FlatArray<Transfer> transfers;
+    FlatArray<Transfer> backward_transfers;
+    FlatArray<trip_pos_t> trip_positions;
+    FlatArray<hub_t> in_hubs;
+    FlatArray<hub_t> out_hubs;
+
+    // The stops having a given hub as in-hub (resp. out-hub) are stored contiguously,
+    // the slice of the hub h is [inverse_in_hubs_idx[h], inverse_in_hubs_idx[h + 1])
+    FlatArray<hub_t> inverse_in_hubs;
+    FlatArray<hub_t> inverse_out_hubs;
+    FlatArray<size_t> inverse_in_hubs_idx;
+    FlatArray<size_t> inverse_out_hubs_idx;
+
+    // The stops and the routes are renumbered for locality, these arrays map them to their ids
+    // in the dataset and back, the other arrays only use the new ids
+    FlatArray<node_id_t> external_stop_ids;
+    FlatArray<node_id_t> internal_stop_ids;
+    FlatArray<route_id_t> external_route_ids;
 
     Time walking_time(const node_id_t& source_id, const node_id_t& target_id) const;
 
-    Timetable() {
-        path = "../../Public-Transit-Data/" + name + "/";
-        parse_data();
+    // The dataset given by the name in the configuration
+    Timetable() : Timetable("../../Public-Transit-Data/" + name + "/") {}
+
+    // The dataset in the given directory, the path ends with a slash
+    explicit Timetable(const std::string& dataset_path) {
+        path = dataset_path;
+
+        if (use_snapshot) {
+            load_snapshot(snapshot_path());
+        } else {
+            parse_data();
+        }
+    }
+
+    // The default location of the snapshot of the dataset
+    std::string snapshot_path() const;
+
+    // Write all the flat arrays into a binary snapshot, which can be loaded later without parsing
+    void write_snapshot(const std::string& file_path) const;
+
+    // Map the snapshot into memory and use it directly as the flat arrays, without copying.
+    // A std::runtime_error is thrown if the snapshot is invalid or was built for another mode.
+    void load_snapshot(const std::string& file_path);
+
+    // Apply f(name, array) to each flat array, in the order in which they are stored in the snapshot
+    template<class T, class F>
+    static void for_each_array(T& timetable, F& f) {
+        f("routes", timetable.routes);
+        f("stops", timetable.stops);
+        f("route_stops", timetable.route_stops);
+        f("route_trips", timetable.route_trips);
+        f("trip_offsets", timetable.trip_offsets);
+        f("stop_times", timetable.stop_times);
+        f("departures", timetable.departures);
+        f("arrivals", timetable.arrivals);
+        f("stop_routes", timetable.stop_routes);
+        f("transfers", timetable.transfers);
+        f("backward_transfers", timetable.backward_transfers);
+        f("trip_positions", timetable.trip_positions);
+        f("in_hubs", timetable.in_hubs);
+        f("out_hubs", timetable.out_hubs);
+        f("inverse_in_hubs", timetable.inverse_in_hubs);
+        f("inverse_out_hubs", timetable.inverse_out_hubs);
+        f("inverse_in_hubs_idx", timetable.inverse_in_hubs_idx);
+        f("inverse_out_hubs_idx", timetable.inverse_out_hubs_idx);
+        f("external_stop_ids", timetable.external_stop_ids);
+        f("internal_stop_ids", timetable.internal_stop_ids);
+        f("external_route_ids", timetable.external_route_ids);
+    }
+
+    // The stop pattern of the route
+    Range<node_id_t> stops_of(const Route& route) const {
+        return {route_stops.data() + route.stops_idx, route.n_stops};
+    }
+
+    // The trips of the route, sorted by their departure time
+    Range<trip_id_t> trips_of(const Route& route) const {
+        return {route_trips.data() + route.trips_idx, route.n_trips};
+    }
+
+    // The row of stop events of the trip at position trip_pos in the route, the times of the trip are those
+    // of the row shifted by trip_offset(route, trip_pos). The row of a periodic route is that of its first trip.
+    const StopTime* trip_row(const Route& route, const size_t& trip_pos) const {
+        return stop_times.data() + route.stop_times_idx + (route.is_periodic ? 0 : trip_pos * route.n_stops);
+    }
+
+    // The offset of the trip at position trip_pos in the route, from the row of the trip
+    const Time::value_type& trip_offset(const Route& route, const size_t& trip_pos) const {
+        return trip_offsets[route.trips_idx + trip_pos];
+    }
+
+    // The stop event of the trip at position trip_pos in the route at the stop at position stop_idx
+    StopTime stop_time(const Route& route, const size_t& trip_pos, const size_t& stop_idx) const {
+        const auto& row_stop_time = trip_row(route, trip_pos)[stop_idx];
+        const auto& offset = trip_offset(route, trip_pos);
+
+        return {row_stop_time.arr.val() + offset, row_stop_time.dep.val() + offset};
+    }
+
+    // The departure times of all the trips of the route at the stop at position stop_idx in the stop pattern
+    TimeColumn departures_of_stop(const Route& route, const size_t& stop_idx) const {
+        if (route.is_periodic) {
+            return {{trip_offsets.data() + route.trips_idx, route.n_trips},
+                    stop_times[route.stop_times_idx + stop_idx].dep.val()};
+        }
+
+        return {{departures.data() + route.columns_idx + stop_idx * route.n_trips, route.n_trips}, 0};
+    }
+
+    // The arrival times of all the trips of the route at the stop at position stop_idx in the stop pattern
+    TimeColumn arrivals_of_stop(const Route& route, const size_t& stop_idx) const {
+        if (route.is_periodic) {
+            return {{trip_offsets.data() + route.trips_idx, route.n_trips},
+                    stop_times[route.stop_times_idx + stop_idx].arr.val()};
+        }
+
+        return {{arrivals.data() + route.columns_idx + stop_idx * route.n_trips, route.n_trips}, 0};
+    }
+
+    // The routes serving the stop, with the positions of the stop in each of them
+    Range<StopRoute> routes_of(const Stop& stop) const {
+        return {stop_routes.data() + stop.routes_idx, stop.n_routes};
+    }
+
+    Range<Transfer> transfers_of(const Stop& stop) const {
+        return {transfers.data() + stop.transfers_idx, stop.n_transfers};
+    }
+
+    // The transfers arriving at the stop, their destination is the stop they leave from
+    Range<Transfer> backward_transfers_of(const Stop& stop) const {
+        return {backward_transfers.data() + stop.backward_transfers_idx, stop.n_backward_transfers};
+    }
+
+    Range<hub_t> in_hubs_of(const Stop& stop) const {
+        return {in_hubs.data() + stop.in_hubs_idx, stop.n_in_hubs};
+    }
+
+    Range<hub_t> out_hubs_of(const Stop& stop) const {
+        return {out_hubs.data() + stop.out_hubs_idx, stop.n_out_hubs};
+    }
+
+    // The stops having the hub as in-hub
+    Range<hub_t> inverse_in_hubs_of(const node_id_t& hub_id) const {
+        return {inverse_in_hubs.data() + inverse_in_hubs_idx[hub_id],
+                inverse_in_hubs.data() + inverse_in_hubs_idx[hub_id + 1]};
+    }
+
+    // The stops having the hub as out-hub
+    Range<hub_t> inverse_out_hubs_of(const node_id_t& hub_id) const {
+        return {inverse_out_hubs.data() + inverse_out_hubs_idx[hub_id],
+                inverse_out_hubs.data() + inverse_out_hubs_idx[hub_id + 1]};
     }
 
     void summary() const;
@@ -1,26 +1,234 @@
 #include <iomanip>
 #include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
 
 #include "experiments.hpp"
+#include "mc_raptor.hpp"
 #include "raptor.hpp"
 #include "csv.h"
-#include "gzstream.h"
+#include "gz_source.hpp"
+#include "parallel.hpp"
+#include "profiler.hpp"
 
 
-void write_results(const Results& results) {
-    std::string algo_str = use_hl ? "HLR" : "R";
+// The name of the algorithm in the names of the output files
+std::string algo_name() {
+    return std::string(use_hl ? "HL" : "") + (multi_criteria ? "McR" : "R");
+}
+
+
+// Write the journeys found by the range or multi-criteria queries, one row per journey
+void write_journeys(const Results& results) {
+    std::ofstream journeys_file {"../" + name + "_" + algo_name() + "_journeys.csv"};
+
+    journeys_file << "query,departure,arrival,transfers" << (multi_criteria ? ",walking_time\n" : "\n");
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        for (const auto& journey: results[i].journeys) {
+            journeys_file << i << ',' << journey.dep << ',' << journey.arr << ',' << journey.n_transfers;
+
+            if (multi_criteria) {
+                journeys_file << ',' << journey.walking_time;
+            }
+
+            journeys_file << '\n';
+        }
+    }
+}
+
+
+// Write the legs of the journeys, one row per leg, the trip of a walking leg is -1
+void write_legs(const Results& results) {
+    std::ofstream legs_file {"../" + name + "_" + algo_name() + "_legs.csv"};
+
+    legs_file << "query,journey,from,to,trip,departure,arrival\n";
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        for (size_t j = 0; j < results[i].journeys.size(); ++j) {
+            for (const auto& leg: results[i].journeys[j].legs) {
+                legs_file << i << ',' << j << ',' << leg.from << ',' << leg.to << ',' << leg.trip << ','
+                          << leg.dep << ',' << leg.arr << '\n';
+            }
+        }
+    }
+}
+
+
+// Write the work done by the queries, one row per round
+void write_stats(const Results& results) {
+    std::ofstream stats_file {"../" + name + "_" + algo_name() + "_stats.csv"};
+
+    stats_file << "query,round,marked_stops,queued_routes,visited_events,earliest_trip_calls,"
+               << "relaxed_edges,improved_labels\n";
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        for (size_t k = 0; k < results[i].stats.size(); ++k) {
+            const auto& round_stats = results[i].stats[k];
+
+            stats_file << i << ',' << k + 1 << ',' << round_stats.marked_stops << ',' << round_stats.queued_routes
+                       << ',' << round_stats.visited_events << ',' << round_stats.earliest_trip_calls << ','
+                       << round_stats.relaxed_edges << ',' << round_stats.improved_labels << '\n';
+        }
+    }
+}
+
+
+// Print the percentiles of the running times for each rank and for all the queries,
+// and write them in a file with one row per rank, the last row being for all the queries
+void report_latencies(const Latencies& latencies) {
+    Histogram all;
+    for (const auto& kv: latencies) {
+        all.merge(kv.second);
+    }
+
+    std::ofstream latency_file {"../" + name + "_" + algo_name() + "_latency.csv"};
+    latency_file << "rank,queries,min,p50,p90,p99,p99.9,max\n";
+    latency_file << std::fixed << std::setprecision(4);
+
+    std::cout << "Running times (ms):" << std::endl;
+    std::cout << std::setw(6) << "rank" << std::setw(10) << "queries";
+    for (const auto& column: {"min", "p50", "p90", "p99", "p99.9", "max"}) {
+        std::cout << std::setw(10) << column;
+    }
+    std::cout << std::endl;
+
+    auto write_row = [&](const std::string& rank, const Histogram& histogram) {
+        const std::vector<uint64_t> values {histogram.min(), histogram.percentile(50), histogram.percentile(90),
+                                            histogram.percentile(99), histogram.percentile(99.9), histogram.max()};
+
+        latency_file << rank << ',' << histogram.count();
+        std::cout << std::setw(6) << rank << std::setw(10) << histogram.count();
+
+        for (const auto& value: values) {
+            const double ms = static_cast<double>(value) / 1e6;
+
+            latency_file << ',' << ms;
+            std::cout << std::setw(10) << std::fixed << std::setprecision(4) << ms;
+        }
+
+        latency_file << '\n';
+        std::cout << std::endl;
+    };
+
+    for (const auto& kv: latencies) {
+        write_row(std::to_string(kv.first), kv.second);
+    }
+
+    write_row("all", all);
+
+    std::cout.unsetf(std::ios_base::floatfield);
+    std::cout.precision(6);
+}
+
+
+// Print the hardware events of all the queries in each phase, with the instructions per cycle and the misses
+// per thousand instructions, and write the events of each query in a file with one row per phase.
+// The events which cannot be counted on this CPU are left empty.
+void report_perf(const Results& results, const perf::Counters& counters) {
+    std::ofstream perf_file {"../" + name + "_" + algo_name() + "_perf.csv"};
+    perf_file << "query,phase";
+    for (size_t e = 0; e < perf::n_events; ++e) {
+        perf_file << ',' << perf::event_name(e);
+    }
+    perf_file << '\n';
+
+    PhaseCounts totals;
+    perf::Sample all;
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        for (size_t p = 0; p < phase::n_phases; ++p) {
+            const auto& sample = results[i].perf[p];
+
+            perf_file << i << ',' << phase::name(p);
+            for (size_t e = 0; e < perf::n_events; ++e) {
+                perf_file << ',';
+                if (counters.counts(e)) perf_file << sample.values[e];
+            }
+            perf_file << '\n';
+
+            totals[p] += sample;
+            all += sample;
+        }
+    }
+
+    std::cout << "Hardware events (misses per 1000 instructions):" << std::endl;
+    std::cout << std::setw(16) << "phase" << std::setw(14) << "cycles" << std::setw(14) << "instructions";
+    for (const auto& column: {"IPC", "L1D", "LLC", "branch"}) {
+        std::cout << std::setw(8) << column;
+    }
+    std::cout << std::endl;
+
+    auto print_row = [&](const std::string& phase_name, const perf::Sample& sample) {
+        const auto& values = sample.values;
+        const auto n_instructions = static_cast<double>(values[perf::instructions]);
+
+        auto print_ratio = [&](const size_t& event, const double& denominator, const double& scale) {
+            std::cout << std::setw(8);
+            if (counters.counts(event) && denominator > 0) {
+                std::cout << std::fixed << std::setprecision(2) << scale * static_cast<double>(values[event]) /
+                                                                   denominator;
+            } else {
+                std::cout << "n/a";
+            }
+        };
+
+        std::cout << std::setw(16) << phase_name << std::setw(14) << values[perf::cycles] << std::setw(14);
+        if (counters.counts(perf::instructions)) {
+            std::cout << values[perf::instructions];
+        } else {
+            std::cout << "n/a";
+        }
 
-    std::ofstream running_time_file {"../" + name + "_" + algo_str + "_running_time.csv"};
-    std::ofstream arrival_times_file {"../" + name + "_" + algo_str + "_arrival_times.csv"};
+        print_ratio(perf::instructions, static_cast<double>(values[perf::cycles]), 1);
+        print_ratio(perf::l1d_misses, n_instructions, 1000);
+        print_ratio(perf::llc_misses, n_instructions, 1000);
+        print_ratio(perf::branch_misses, n_instructions, 1000);
+        std::cout << std::endl;
+    };
 
+    for (size_t p = 0; p < phase::n_phases; ++p) {
+        print_row(phase::name(p), totals[p]);
+    }
+
+    print_row("all", all);
+
+    std::cout.unsetf(std::ios_base::floatfield);
+    std::cout.precision(6);
+}
+
+
+void write_results(const Results& results) {
+    std::ofstream running_time_file {"../" + name + "_" + algo_name() + "_running_time.csv"};
     running_time_file << "running_time\n";
-    arrival_times_file << "arrival_times\n";
 
     running_time_file << std::fixed << std::setprecision(4);
 
     for (const auto& result: results) {
         running_time_file << result.running_time << '\n';
+    }
+
+    if (record_journeys) {
+        write_legs(results);
+    }
+
+    if (record_stats) {
+        write_stats(results);
+    }
+
+    if (range_window > 0 || multi_criteria) {
+        write_journeys(results);
+        return;
+    }
 
+    // The arrive-by queries give the latest departure times in each round instead
+    const std::string times_str = arrive_by ? "departure_times" : "arrival_times";
+
+    std::ofstream arrival_times_file {"../" + name + "_" + algo_name() + "_" + times_str + ".csv"};
+    arrival_times_file << times_str << '\n';
+
+    for (const auto& result: results) {
         bool first = true;
         for (const auto& elem: result.arrival_times) {
             if (first) {
@@ -42,45 +250,142 @@ Queries Experiment::read_queries() {
     std::string rank_str = ranked ? "rank_" : "";
     auto queries_file = read_dataset_file<std::ifstream>(m_timetable->path + rank_str + "queries.csv");
 
-    igzstream queries_file_stream {(m_timetable->path + rank_str + "queries.csv").c_str()};
-    io::CSVReader<4> queries_file_reader {"queries.csv", queries_file_stream};
+    io::CSVReader<4> queries_file_reader {"queries.csv", open_gz(m_timetable->path + rank_str + "queries.csv")};
     queries_file_reader.read_header(io::ignore_no_column, "rank", "source", "target", "time");
 
     uint16_t r;
     node_id_t s, t;
     Time::value_type d;
 
+    // The queries use the ids of the dataset, while the timetable has renumbered the stops
+    auto internal_stop_id = [&](const node_id_t& stop_id) {
+        if (stop_id >= m_timetable->internal_stop_ids.size()) {
+            throw std::runtime_error("Unknown stop " + std::to_string(stop_id) + " in the queries");
+        }
+
+        return m_timetable->internal_stop_ids[stop_id];
+    };
+
     while (queries_file_reader.read_row(r, s, t, d)) {
-        queries.emplace_back(r, s, t, d);
+        queries.emplace_back(r, internal_stop_id(s), internal_stop_id(t), d);
     }
 
     return queries;
 }
 
 
+const size_t Experiment::chunk_size;
+
+
+// The legs are written with the ids of the stops in the dataset
+void Experiment::to_external_ids(std::vector<Leg>& legs) const {
+    for (auto& leg: legs) {
+        leg.from = m_timetable->external_stop_ids[leg.from];
+        leg.to = m_timetable->external_stop_ids[leg.to];
+    }
+}
+
+
 void Experiment::run() const {
     Results res;
-    Raptor raptor {m_timetable};
+    Timer timer;
+
+    // Each thread has its own engine, since the labels of a query are modified while it is answered,
+    // the engines are created by the threads using them so that the labels are allocated close to them
+    std::vector<std::unique_ptr<Raptor>> engines(default_n_threads(n_threads));
+    std::vector<std::unique_ptr<McRaptor>> mc_engines(engines.size());
+
+    // The running times are recorded by each thread in its own histograms, which are merged at the end
+    std::vector<Latencies> thread_latencies(engines.size());
+
+    // The engines open their own counters, these ones only tell which events can be counted
+    std::unique_ptr<perf::Counters> counters;
+    if (record_perf) {
+        counters.reset(new perf::Counters);
+
+        if (!counters->available()) {
+            std::cerr << "The hardware counters are unavailable (" << counters->error()
+                      << "), the hardware events are not recorded" << std::endl;
+        }
+    }
 
     res.resize(m_queries.size());
-    for (size_t i = 0; i < m_queries.size(); ++i) {
-        auto query = m_queries[i];
+    parallel_for(m_queries.size(), chunk_size, n_threads, [&](size_t thread_idx, size_t begin, size_t end) {
+        auto& raptor = engines[thread_idx];
+        auto& mc_raptor = mc_engines[thread_idx];
+        if (multi_criteria && !mc_raptor) {
+            mc_raptor.reset(new McRaptor {m_timetable});
+        } else if (!multi_criteria && !raptor) {
+            raptor.reset(new Raptor {m_timetable});
+        }
+
+        for (size_t i = begin; i < end; ++i) {
+            const auto& query = m_queries[i];
+
+            Timer query_timer;
 
-        std::vector<Time> arrival_times;
-        raptor.init();
-        Timer timer;
+            // Each query has its own slot, so the results are in the order of the queries
+            if (multi_criteria) {
+                auto journeys = mc_raptor->query(query.source_id, query.target_id, query.dep);
 
-        arrival_times = raptor.query(query.source_id, query.target_id, query.dep);
+                res[i] = {query.rank, query_timer.elapsed(), std::move(journeys)};
+            } else if (range_window > 0) {
+                auto journeys = raptor->range_query(query.source_id, query.target_id,
+                                                    query.dep, query.dep + Time(range_window));
 
-        double running_time = timer.elapsed();
+                for (auto& journey: journeys) {
+                    to_external_ids(journey.legs);
+                }
+
+                res[i] = {query.rank, query_timer.elapsed(), std::move(journeys)};
+            } else if (arrive_by) {
+                auto departure_times = raptor->backward_query(query.source_id, query.target_id, query.dep);
+
+                res[i] = {query.rank, query_timer.elapsed(), std::move(departure_times)};
+            } else {
+                QueryStats stats;
+                auto arrival_times = raptor->query(query.source_id, query.target_id, query.dep,
+                                                   record_stats ? &stats : nullptr);
+                std::vector<Journey> journeys;
+
+                // The journey arriving the earliest, with as few transfers as possible
+                if (record_journeys && arrival_times.back()) {
+                    size_t round = 0;
+                    while (!(arrival_times[round] == arrival_times.back())) ++round;
+
+                    const auto n_transfers = static_cast<uint16_t>(round > 0 ? round - 1 : 0);
+
+                    journeys.emplace_back(query.dep, arrival_times[round], n_transfers);
+                    journeys.back().legs = raptor->journey(query.target_id, round);
+                    to_external_ids(journeys.back().legs);
+                }
+
+                res[i] = {query.rank, query_timer.elapsed(), std::move(arrival_times)};
+                res[i].journeys = std::move(journeys);
+                res[i].stats = std::move(stats);
+                res[i].perf = raptor->phase_counts();
+            }
+
+            thread_latencies[thread_idx][query.rank].record(static_cast<uint64_t>(res[i].running_time * 1e6));
+        }
+    });
+
+    std::cout << "Answered " << m_queries.size() << " queries in " << timer.elapsed() << timer.unit() << std::endl;
+
+    Latencies latencies;
+    for (const auto& thread_latency: thread_latencies) {
+        for (const auto& kv: thread_latency) {
+            latencies[kv.first].merge(kv.second);
+        }
+    }
 
-        raptor.clear();
-        res[i] = {query.rank, running_time, arrival_times};
+    report_latencies(latencies);
 
-        std::cout << i << std::endl;
+    if (counters && counters->available()) {
+        report_perf(res, *counters);
     }
 
     write_results(res);
 
-    Profiler::report();
+    profiler::report();
 }
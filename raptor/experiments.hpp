@@ -1,11 +1,14 @@
 #ifndef EXPERIMENTS_HPP
 #define EXPERIMENTS_HPP
 
+#include <map>
 #include <utility> // std::move
 #include <vector>
 
 #include "config.hpp"
 #include "data_structure.hpp"
+#include "histogram.hpp"
+#include "raptor.hpp"
 
 
 struct Query {
@@ -25,27 +28,54 @@ using Queries = std::vector<Query>;
 struct Result {
     uint16_t rank;
     double running_time;
+    // The arrival times in each round, or the departure times for the arrive-by queries
     std::vector<Time> arrival_times;
+    std::vector<Journey> journeys;
+    // The work done in each round, only counted for the earliest arrival queries
+    QueryStats stats;
+    // The hardware events in each phase, only counted for the earliest arrival queries
+    PhaseCounts perf;
 
-    Result() : rank {}, running_time {}, arrival_times {} {};
+    Result() : rank {}, running_time {}, arrival_times {}, journeys {} {};
 
     Result(uint16_t r, double rt, std::vector<Time> a) : rank {r}, running_time {rt}, arrival_times {std::move(a)} {};
+
+    Result(uint16_t r, double rt, std::vector<Journey> j) : rank {r}, running_time {rt}, journeys {std::move(j)} {};
 };
 
 
 using Results = std::vector<Result>;
 
 
+// The histograms of the running times of the queries in nanoseconds, by rank
+using Latencies = std::map<uint16_t, Histogram>;
+
+
+void write_journeys(const Results& results);
+
+void write_legs(const Results& results);
+
+void write_stats(const Results& results);
+
+void report_latencies(const Latencies& latencies);
+
+void report_perf(const Results& results, const perf::Counters& counters);
+
 void write_results(const Results& results);
 
 
 class Experiment {
 private:
+    // The number of queries a thread takes at once, large enough to make the scheduling negligible
+    static const size_t chunk_size = 64;
+
     const Timetable* const m_timetable;
     const Queries m_queries;
 
     Queries read_queries();
 
+    void to_external_ids(std::vector<Leg>& legs) const;
+
 public:
     explicit Experiment(const Timetable* timetable) :
             m_timetable {timetable}, m_queries {read_queries()} {}
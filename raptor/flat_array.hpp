@@ -0,0 +1,149 @@
+#ifndef FLAT_ARRAY_HPP
+#define FLAT_ARRAY_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+// A contiguous array which either owns its elements, or is a read-only view
+// over memory owned by someone else, e.g., a memory-mapped snapshot file.
+// The owning array can be modified like a std::vector while the timetable is
+// being built, the elements are always read through the same pointer so that
+// both kinds of arrays are equally fast to access.
+template<class T>
+class FlatArray {
+    static_assert(std::is_standard_layout<T>::value, "The elements must be stored as raw bytes");
+
+private:
+    std::vector<T> m_storage;
+    const T* m_data = nullptr;
+    std::size_t m_size = 0;
+    bool m_owning = true;
+
+    void update_view() {
+        m_data = m_storage.data();
+        m_size = m_storage.size();
+        m_owning = true;
+    }
+
+public:
+    using value_type = T;
+
+    FlatArray() = default;
+
+    FlatArray(const FlatArray& other) : m_storage {other.m_storage} {
+        if (other.m_owning) {
+            update_view();
+        } else {
+            map(other.m_data, other.m_size);
+        }
+    }
+
+    FlatArray(FlatArray&& other) noexcept : m_storage {std::move(other.m_storage)} {
+        if (other.m_owning) {
+            update_view();
+        } else {
+            map(other.m_data, other.m_size);
+        }
+    }
+
+    FlatArray& operator=(FlatArray other) {
+        std::swap(m_storage, other.m_storage);
+        if (other.m_owning) {
+            update_view();
+        } else {
+            map(other.m_data, other.m_size);
+        }
+
+        return *this;
+    }
+
+    FlatArray& operator=(std::vector<T>&& elements) {
+        m_storage = std::move(elements);
+        update_view();
+
+        return *this;
+    }
+
+    // Make the array a view over size elements beginning at data, which must outlive the array
+    void map(const T* data, std::size_t size) {
+        m_storage.clear();
+        m_storage.shrink_to_fit();
+        m_data = data;
+        m_size = size;
+        m_owning = false;
+    }
+
+    bool is_owning() const { return m_owning; }
+
+    const T* data() const { return m_data; }
+
+    std::size_t size() const { return m_size; }
+
+    bool empty() const { return m_size == 0; }
+
+    const T& operator[](const std::size_t& i) const { return m_data[i]; }
+
+    const T* begin() const { return m_data; }
+
+    const T* end() const { return m_data + m_size; }
+
+    const T& back() const { return m_data[m_size - 1]; }
+
+    // The remaining functions modify the array, they are only available for owning arrays
+
+    T& operator[](const std::size_t& i) {
+        assert(m_owning);
+        return m_storage[i];
+    }
+
+    T* begin() {
+        assert(m_owning);
+        return m_storage.data();
+    }
+
+    T* end() {
+        assert(m_owning);
+        return m_storage.data() + m_storage.size();
+    }
+
+    T& back() {
+        assert(m_owning);
+        return m_storage.back();
+    }
+
+    void push_back(const T& elem) {
+        assert(m_owning);
+        m_storage.push_back(elem);
+        update_view();
+    }
+
+    template<class... Args>
+    void emplace_back(Args&& ... args) {
+        assert(m_owning);
+        m_storage.emplace_back(std::forward<Args>(args)...);
+        update_view();
+    }
+
+    void resize(const std::size_t& size) {
+        assert(m_owning);
+        m_storage.resize(size);
+        update_view();
+    }
+
+    void reserve(const std::size_t& size) {
+        assert(m_owning);
+        m_storage.reserve(size);
+        update_view();
+    }
+
+    void clear() {
+        m_storage.clear();
+        update_view();
+    }
+};
+
+#endif // FLAT_ARRAY_HPP
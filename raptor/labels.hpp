@@ -0,0 +1,126 @@
+#ifndef LABELS_HPP
+#define LABELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// An array of labels that can be reset to a default value in constant time. Each entry stores
+// the epoch in which it was last written, and an entry from an older epoch reads as the default
+// value, so that starting a new query only increments the current epoch.
+template<class T>
+class EpochArray {
+private:
+    struct Entry {
+        T value;
+        uint32_t epoch;
+    };
+
+    std::vector<Entry> m_entries;
+    uint32_t m_epoch = 1;
+    T m_default;
+
+public:
+    explicit EpochArray(const T& default_value = T()) : m_default {default_value} {}
+
+    // Resize the array, all the labels are reset to the default value
+    void resize(const std::size_t& n) {
+        m_entries.assign(n, Entry {m_default, 0});
+        m_epoch = 1;
+    }
+
+    std::size_t size() const { return m_entries.size(); }
+
+    // Reset all the labels to the default value
+    void reset() {
+        ++m_epoch;
+
+        // The epochs wrapped around, the entries written 2^32 epochs ago would look current
+        if (m_epoch == 0) {
+            resize(m_entries.size());
+        }
+    }
+
+    // Whether the label was written in the current epoch
+    bool is_set(const std::size_t& i) const { return m_entries[i].epoch == m_epoch; }
+
+    const T& operator[](const std::size_t& i) const {
+        const auto& entry = m_entries[i];
+        return entry.epoch == m_epoch ? entry.value : m_default;
+    }
+
+    void set(const std::size_t& i, const T& value) {
+        m_entries[i] = {value, m_epoch};
+    }
+};
+
+
+// The labels of all the rounds of a query, the label in round k is the best value using at most k trips,
+// so that the labels do not increase from one round to the next. A round only stores the labels
+// written in it, the other labels are read from the previous rounds, hence adding a round
+// and resetting all the rounds take constant time.
+template<class T>
+class RoundLabels {
+private:
+    std::vector<EpochArray<T>> m_rounds;
+    std::size_t m_n_rounds = 0;
+    std::size_t m_size = 0;
+    T m_default;
+
+public:
+    explicit RoundLabels(const T& default_value = T()) : m_default {default_value} {}
+
+    // Resize the labels of each round, all the rounds are removed
+    void resize(const std::size_t& n) {
+        m_rounds.clear();
+        m_n_rounds = 0;
+        m_size = n;
+    }
+
+    std::size_t n_rounds() const { return m_n_rounds; }
+
+    // Remove all the rounds, the allocated rounds are kept to be reused
+    void reset() {
+        for (std::size_t round = 0; round < m_n_rounds; ++round) {
+            m_rounds[round].reset();
+        }
+
+        m_n_rounds = 0;
+    }
+
+    // Add the rounds up to the given round, their labels are those of the last round
+    void add_rounds(const std::size_t& round) {
+        for (; m_n_rounds <= round; ++m_n_rounds) {
+            if (m_n_rounds == m_rounds.size()) {
+                m_rounds.emplace_back(m_default);
+                m_rounds.back().resize(m_size);
+            }
+        }
+    }
+
+    const T& operator()(std::size_t round, const std::size_t& i) const {
+        while (!m_rounds[round].is_set(i)) {
+            if (round == 0) return m_default;
+            --round;
+        }
+
+        return m_rounds[round][i];
+    }
+
+    // Lower the label in the round, and in the later rounds in which it is larger
+    void improve(const std::size_t& round, const std::size_t& i, const T& value) {
+        m_rounds[round].set(i, value);
+
+        for (std::size_t later = round + 1; later < m_n_rounds; ++later) {
+            if (!m_rounds[later].is_set(i)) continue;
+
+            // The labels in the following rounds are not larger than this one
+            if (!(value < m_rounds[later][i])) break;
+
+            m_rounds[later].set(i, value);
+        }
+    }
+};
+
+#endif // LABELS_HPP
@@ -1,4 +1,7 @@
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
 
 #include "config.hpp"
 #include "clara.hpp"
@@ -9,14 +12,41 @@ std::string name;
 bool use_hl;
 bool profile;
 bool ranked;
+bool use_snapshot;
+bool verify_snapshot;
+std::size_t n_threads = 1;
+int range_window = 0;
+bool record_journeys;
+bool multi_criteria;
+bool arrive_by;
+bool record_stats;
+bool record_perf;
 
 
 int main(int argc, char* argv[]) {
     bool show_help = false;
+    bool build_snapshot = false;
     auto cli_parser = clara::Arg(name, "name")("The name of the dataset to be used in the algorithm") |
                       clara::Opt(use_hl)["--hl"]("Unrestricted walking with hub labelling") |
                       clara::Opt(profile)["-p"]["--profile"]("Run profile query") |
                       clara::Opt(ranked)["-r"]["--ranked"]("Use ranked queries") |
+                      clara::Opt(build_snapshot)["--build-snapshot"]
+                              ("Parse the dataset and write its binary snapshot") |
+                      clara::Opt(use_snapshot)["-s"]["--snapshot"]("Load the timetable from its binary snapshot") |
+                      clara::Opt(verify_snapshot)["--verify"]("Verify the checksums of the snapshot") |
+                      clara::Opt(n_threads, "threads")["-t"]["--threads"]
+                              ("The number of threads parsing the data and answering the queries, 0 for all the cores") |
+                      clara::Opt(range_window, "seconds")["--range"]
+                              ("Find all the journeys leaving within the given time after each departure") |
+                      clara::Opt(record_journeys)["--journeys"]("Write the legs of the journeys found by the queries") |
+                      clara::Opt(multi_criteria)["--mc"]
+                              ("Find the journeys optimal for the arrival time, the transfers and the walking time") |
+                      clara::Opt(arrive_by)["--arrive-by"]
+                              ("Find the latest departures arriving by the time of each query") |
+                      clara::Opt(record_stats)["--stats"]
+                              ("Write the work done in each round of the earliest arrival queries") |
+                      clara::Opt(record_perf)["--perf"]
+                              ("Count the hardware events in each phase of the earliest arrival queries") |
                       clara::Help(show_help);
 
     auto result = cli_parser.parse(clara::Args(argc, argv));
@@ -30,10 +60,47 @@ int main(int argc, char* argv[]) {
         return 0;
     }
 
-    Timetable timetable;
-    timetable.summary();
+    // The kinds of queries exclude each other, and only the earliest arrival queries record their work
+    const int n_query_kinds = (multi_criteria ? 1 : 0) + (range_window > 0 ? 1 : 0) + (arrive_by ? 1 : 0);
+    std::string error;
 
-    Experiment exp {&timetable};
+    if (range_window < 0) {
+        error = "--range must be positive";
+    } else if (n_query_kinds > 1) {
+        error = "--mc, --range and --arrive-by cannot be combined";
+    } else if (multi_criteria && profile) {
+        error = "--mc does not support the profile queries of --profile";
+    } else if (n_query_kinds > 0 && (record_stats || record_perf)) {
+        error = "--stats and --perf only apply to the earliest arrival queries, not to --mc, --range or --arrive-by";
+    }
+
+    if (!error.empty()) {
+        std::cerr << "Error in command line: " << error << std::endl;
+        exit(1);
+    }
+
+    if (build_snapshot) {
+        use_snapshot = false;
+    }
+
+    std::unique_ptr<Timetable> timetable;
+    try {
+        timetable.reset(new Timetable {});
+
+        if (build_snapshot) {
+            timetable->write_snapshot(timetable->snapshot_path());
+            std::cout << "Snapshot written to " << timetable->snapshot_path() << std::endl;
+
+            return 0;
+        }
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Error while loading the timetable: " << e.what() << std::endl;
+        exit(1);
+    }
+
+    timetable->summary();
+
+    Experiment exp {timetable.get()};
     exp.run();
 
     return 0;
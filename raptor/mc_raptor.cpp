@@ -0,0 +1,257 @@
+#include <algorithm> // std::any_of, std::copy, std::copy_backward, std::lower_bound, std::remove_if, std::sort
+#include <utility> // std::swap
+
+#include "mc_raptor.hpp"
+#include "search.hpp"
+
+
+bool BagPool::dominates(const std::size_t& i, const McLabel& label) const {
+    const auto& bag = this->bag(i);
+
+    // Among the labels arriving at the same time or earlier, the last one walks the least
+    const auto iter = std::upper_bound(bag.begin(), bag.end(), label.arr,
+                                       [](const Time::value_type& arr, const McLabel& l) { return arr < l.arr; });
+
+    return iter != bag.begin() && (iter - 1)->walking_time <= label.walking_time;
+}
+
+
+bool BagPool::merge(const std::size_t& i, const McLabel& label) {
+    if (dominates(i, label)) return false;
+
+    auto slot = m_slots[i];
+    auto* bag = m_pool.data() + slot.begin;
+
+    // The labels dominated by the new one arrive at the same time or later, and walk at least as much,
+    // they follow each other from the position of the new label since the walking times decrease
+    const auto lo = static_cast<uint32_t>(
+            std::lower_bound(bag, bag + slot.size, label.arr,
+                             [](const McLabel& l, const Time::value_type& arr) { return l.arr < arr; }) - bag);
+
+    auto hi = lo;
+    while (hi < slot.size && bag[hi].walking_time >= label.walking_time) ++hi;
+
+    if (hi > lo) {
+        bag[lo] = label;
+        std::copy(bag + hi, bag + slot.size, bag + lo + 1);
+        slot.size -= hi - lo - 1;
+    } else {
+        // The full bag is moved to the end of the pool with twice its capacity,
+        // its previous slice is only reclaimed by the next reset
+        if (slot.size == slot.capacity) {
+            const auto begin = static_cast<uint32_t>(m_pool.size());
+            const auto capacity = std::max<uint32_t>(4, 2 * slot.capacity);
+
+            m_pool.resize(m_pool.size() + capacity);
+            std::copy(m_pool.begin() + slot.begin, m_pool.begin() + slot.begin + slot.size, m_pool.begin() + begin);
+
+            slot.begin = begin;
+            slot.capacity = capacity;
+            bag = m_pool.data() + slot.begin;
+        }
+
+        std::copy_backward(bag + lo, bag + slot.size, bag + slot.size + 1);
+        bag[lo] = label;
+        ++slot.size;
+    }
+
+    m_slots.set(i, slot);
+
+    return true;
+}
+
+
+// Add the label to the best labels and to the labels of the current round at the stop,
+// unless it is dominated by one of them, or by a label of the target
+bool McRaptor::improve(const node_id_t& stop_id, const McLabel& label) {
+    if (is_pruned(label) || !best_bags.merge(stop_id, label)) return false;
+
+    bags.merge(stop_id, label);
+    marked_stops.insert(stop_id);
+
+    return true;
+}
+
+
+// The route bag is sorted like the bags of the stops, a trip boarded earlier is better
+// since it arrives earlier at all the next stops
+void McRaptor::merge_route_label(const RouteLabel& label) {
+    auto iter = std::lower_bound(route_bag.begin(), route_bag.end(), label.trip_pos,
+                                 [](const RouteLabel& l, const std::size_t& trip_pos) { return l.trip_pos < trip_pos; });
+
+    if (iter != route_bag.begin() && (iter - 1)->walking_time <= label.walking_time) return;
+    if (iter != route_bag.end() && iter->trip_pos == label.trip_pos && iter->walking_time <= label.walking_time) return;
+
+    auto last = iter;
+    while (last != route_bag.end() && last->walking_time >= label.walking_time) ++last;
+
+    if (last > iter) {
+        *iter = label;
+        route_bag.erase(iter + 1, last);
+    } else {
+        route_bag.insert(iter, label);
+    }
+}
+
+
+// Build the queue of routes serving the stops marked in the previous round
+void McRaptor::make_queue() {
+    queue.clear();
+
+    for (const auto& stop_id: prev_marked_stops.members()) {
+        for (const auto& stop_route: m_timetable->routes_of(m_timetable->stops[stop_id])) {
+            queue.add(stop_route.route_id, stop_route.stop_idx);
+        }
+    }
+}
+
+
+void McRaptor::scan_routes() {
+    for (const auto& route_id: queue.routes()) {
+        const auto& route = m_timetable->routes[route_id];
+        const auto& route_stops = m_timetable->stops_of(route);
+
+        route_bag.clear();
+
+        for (size_t i = queue.stop_idx(route_id); i < route_stops.size(); ++i) {
+            const auto& p_i = route_stops[i];
+
+            // The trips of the route bag arrive at p_i, a trip whose label is pruned by the target
+            // is dropped, since it arrives even later at the next stops
+            size_t n_kept = 0;
+            for (const auto& route_label: route_bag) {
+                const McLabel label {m_timetable->stop_time(route, route_label.trip_pos, i).arr.val(),
+                                     route_label.walking_time};
+
+                if (is_pruned(label)) continue;
+
+                improve(p_i, label);
+                route_bag[n_kept++] = route_label;
+            }
+            route_bag.resize(n_kept);
+
+            // The labels of the previous round at p_i board the earliest trip they can catch
+            if (!prev_marked_stops.contains(p_i) || i + 1 == route_stops.size()) continue;
+
+            const auto& departures = m_timetable->departures_of_stop(route, i);
+
+            for (const auto& label: prev_bags.bag(p_i)) {
+                const auto trip_pos = search::first_at_or_after(departures.values.begin(), route.n_trips,
+                                                                label.arr - departures.shift);
+
+                if (trip_pos < route.n_trips) {
+                    merge_route_label({trip_pos, label.walking_time});
+                }
+            }
+        }
+    }
+}
+
+
+// Walk from the labels found by the routes in this round, as in RAPTOR a footpath is not followed by another one
+void McRaptor::scan_footpaths() {
+    walk_labels.clear();
+    for (const auto& stop_id: marked_stops.members()) {
+        for (const auto& label: bags.bag(stop_id)) {
+            walk_labels.emplace_back(stop_id, label);
+        }
+    }
+
+    // The links are sorted by walking time, so the next ones are also pruned once a label is pruned
+    if (!use_hl) {
+        for (const auto& kv: walk_labels) {
+            for (const auto& transfer: m_timetable->transfers_of(m_timetable->stops[kv.first])) {
+                const McLabel label {kv.second.arr + transfer.time.val(),
+                                     kv.second.walking_time + transfer.time.val()};
+
+                if (is_pruned(label)) break;
+
+                improve(transfer.dest, label);
+            }
+        }
+    } else {
+        for (const auto& kv: walk_labels) {
+            for (const auto& out_hub: m_timetable->out_hubs_of(m_timetable->stops[kv.first])) {
+                const McLabel label {kv.second.arr + out_hub.first.val(),
+                                     kv.second.walking_time + out_hub.first.val()};
+
+                if (is_pruned(label)) break;
+
+                if (hub_bags.merge(out_hub.second, label)) {
+                    improved_hubs.insert(out_hub.second);
+                }
+            }
+        }
+
+        for (const auto& hub_id: improved_hubs.members()) {
+            for (const auto& hub_label: hub_bags.bag(hub_id)) {
+                for (const auto& in_hub: m_timetable->inverse_in_hubs_of(hub_id)) {
+                    const McLabel label {hub_label.arr + in_hub.first.val(),
+                                         hub_label.walking_time + in_hub.first.val()};
+
+                    if (is_pruned(label)) break;
+
+                    improve(in_hub.second, label);
+                }
+            }
+        }
+
+        improved_hubs.clear();
+        hub_bags.reset();
+    }
+}
+
+
+std::vector<Journey> McRaptor::query(const node_id_t& source_id, const node_id_t& target_id,
+                                     const Time& departure_time) {
+    std::vector<Journey> journeys;
+
+    m_target_id = target_id;
+    best_bags.reset();
+    bags.reset();
+    marked_stops.clear();
+
+    // The source and the stops reachable by walking from the source are reached in round 0
+    const McLabel source_label {departure_time.val(), 0};
+    best_bags.merge(source_id, source_label);
+    bags.merge(source_id, source_label);
+    marked_stops.insert(source_id);
+    scan_footpaths();
+
+    for (size_t round = 0;; ++round) {
+        // The labels of the target found in a round are not dominated by those of the previous rounds,
+        // which have fewer trips, nor by those of the next rounds, which have more trips. However, walking
+        // without trip and taking one trip both make no transfer, so the walks may be dominated in round 1.
+        const auto& target_bag = bags.bag(target_id);
+
+        if (round == 1) {
+            journeys.erase(std::remove_if(journeys.begin(), journeys.end(), [&](const Journey& journey) {
+                return std::any_of(target_bag.begin(), target_bag.end(), [&](const McLabel& label) {
+                    return label.dominates({journey.arr.val(), journey.walking_time.val()});
+                });
+            }), journeys.end());
+        }
+
+        for (const auto& label: target_bag) {
+            journeys.emplace_back(departure_time, Time(label.arr), static_cast<uint16_t>(round > 0 ? round - 1 : 0),
+                                  Time(label.walking_time));
+        }
+
+        if (marked_stops.empty()) break;
+
+        std::swap(prev_bags, bags);
+        std::swap(prev_marked_stops, marked_stops);
+        bags.reset();
+        marked_stops.clear();
+
+        make_queue();
+        scan_routes();
+        scan_footpaths();
+    }
+
+    std::sort(journeys.begin(), journeys.end(), [](const Journey& j1, const Journey& j2) {
+        return j1.arr < j2.arr || (j1.arr == j2.arr && j1.n_transfers < j2.n_transfers);
+    });
+
+    return journeys;
+}
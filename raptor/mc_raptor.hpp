@@ -0,0 +1,122 @@
+#ifndef MC_RAPTOR_HPP
+#define MC_RAPTOR_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "config.hpp"
+#include "data_structure.hpp"
+#include "labels.hpp"
+#include "raptor.hpp"
+
+
+// A label of McRAPTOR at a stop, the arrival time and the total walking time of a journey.
+// The number of trips of the journey is the round in which the label is found.
+struct McLabel {
+    Time::value_type arr;
+    Time::value_type walking_time;
+
+    // Whether the label is at least as good as the other one for both criteria
+    bool dominates(const McLabel& other) const { return arr <= other.arr && walking_time <= other.walking_time; }
+};
+
+
+// The Pareto sets of labels, or bags, of the stops (or of the hubs) in a round. The bags are slices
+// of a single pool, which is only cleared by a reset, so that no bag is allocated separately.
+// A bag is sorted by arrival time, hence by decreasing walking time since no label dominates another,
+// and a label is merged into it with a binary search and a move of the labels after it.
+class BagPool {
+private:
+    struct Slot {
+        uint32_t begin;
+        uint32_t size;
+        uint32_t capacity;
+    };
+
+    std::vector<McLabel> m_pool;
+    EpochArray<Slot> m_slots;
+
+public:
+    void resize(const std::size_t& n) {
+        m_pool.clear();
+        m_slots.resize(n);
+    }
+
+    // Empty all the bags, the memory of the pool is kept
+    void reset() {
+        m_pool.clear();
+        m_slots.reset();
+    }
+
+    Range<McLabel> bag(const std::size_t& i) const {
+        const auto& slot = m_slots[i];
+        return {m_pool.data() + slot.begin, slot.size};
+    }
+
+    // Whether a label of the bag dominates the label
+    bool dominates(const std::size_t& i, const McLabel& label) const;
+
+    // Add the label to the bag and remove the labels it dominates, unless it is dominated.
+    // Return whether the label is added.
+    bool merge(const std::size_t& i, const McLabel& label);
+};
+
+
+// The multi-criteria version of RAPTOR, it finds the journeys which are Pareto-optimal with respect to
+// the arrival time, the number of transfers and the total walking time. As in RAPTOR, the round k
+// gives the journeys with k trips, so a stop only keeps the labels of the previous and the current round,
+// together with the best labels over all the rounds, which prune the labels found later.
+class McRaptor {
+private:
+    // A trip of the route being scanned, given by its position, and the walking time before boarding it
+    struct RouteLabel {
+        std::size_t trip_pos;
+        Time::value_type walking_time;
+    };
+
+    const Timetable* const m_timetable;
+    node_id_t m_target_id = NULL_STOP;
+    BagPool best_bags;
+    BagPool prev_bags;
+    BagPool bags;
+    BagPool hub_bags;
+    MarkedSet prev_marked_stops;
+    MarkedSet marked_stops;
+    MarkedSet improved_hubs;
+    RouteQueue queue;
+    std::vector<RouteLabel> route_bag;
+    std::vector<std::pair<node_id_t, McLabel>> walk_labels;
+
+    bool is_pruned(const McLabel& label) const { return best_bags.dominates(m_target_id, label); }
+
+    bool improve(const node_id_t& stop_id, const McLabel& label);
+
+    void merge_route_label(const RouteLabel& label);
+
+    void make_queue();
+
+    void scan_routes();
+
+    void scan_footpaths();
+
+public:
+    explicit McRaptor(const Timetable* timetable_p) : m_timetable {timetable_p} {
+        queue.resize(m_timetable->routes.size());
+        best_bags.resize(m_timetable->max_stop_id + 1);
+        prev_bags.resize(m_timetable->max_stop_id + 1);
+        bags.resize(m_timetable->max_stop_id + 1);
+        prev_marked_stops.resize(m_timetable->max_stop_id + 1);
+        marked_stops.resize(m_timetable->max_stop_id + 1);
+
+        if (use_hl) {
+            hub_bags.resize(m_timetable->n_hubs);
+            improved_hubs.resize(m_timetable->n_hubs);
+        }
+    }
+
+    // Find the Pareto-optimal journeys from the source to the target leaving at the departure time,
+    // sorted by arrival time. The journeys made only of walking are included, with no transfer.
+    std::vector<Journey> query(const node_id_t& source_id, const node_id_t& target_id, const Time& departure_time);
+};
+
+#endif // MC_RAPTOR_HPP
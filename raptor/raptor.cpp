@@ -1,87 +1,231 @@
-#include <algorithm> // std::find, std::min
+#include <algorithm> // std::min, std::reverse, std::sort, std::unique
+#include <limits>
 
+#include "parallel.hpp"
+#include "profiler.hpp"
 #include "raptor.hpp"
+#include "search.hpp"
 
 
-// Check if stop1 comes before/after stop2 in the route
-bool Raptor::check_stops_order(const route_id_t& route_id, const node_id_t& stop1, const node_id_t& stop2) {
-    #ifdef PROFILE
-    Profiler prof {__func__};
-    #endif
+const size_t RouteQueue::not_queued;
 
-    const auto& route = m_timetable->routes[route_id];
 
-    const auto& idx1 = route.stop_positions.at(stop1);
-    const auto& idx2 = route.stop_positions.at(stop2);
+namespace {
+    const size_t NULL_ROUND = std::numeric_limits<size_t>::max();
 
-    return idx1 < idx2;
-}
+    // Add the hardware events counted during its lifetime to a sample, nothing is counted without counters
+    class PerfScope {
+    private:
+        const perf::Counters* const m_counters;
+        perf::Sample& m_sample;
+        perf::Sample m_begin;
 
+    public:
+        PerfScope(const perf::Counters* counters, perf::Sample& sample) : m_counters {counters}, m_sample {sample} {
+            if (m_counters != nullptr) m_begin = m_counters->read();
+        }
 
-route_stop_queue_t Raptor::make_queue() {
-    #ifdef PROFILE
-    Profiler prof {__func__};
-    #endif
+        ~PerfScope() {
+            if (m_counters != nullptr) m_sample += m_counters->read() - m_begin;
+        }
+    };
 
-    route_stop_queue_t queue;
+    // The labels of an earliest arrival query, i.e., the earliest arrival time at each stop
+    // over all the rounds so far, and the earliest arrival time at the end of the previous round
+    class EarliestArrivalLabels {
+    private:
+        EpochArray<Time>& m_labels;
+        const EpochArray<Time>& m_prev_labels;
+        const node_id_t m_target_id;
+        const size_t m_round;
 
-    for (const auto& stop: m_timetable->stops) {
-        const auto& stop_id = stop.id;
+    public:
+        EarliestArrivalLabels(EpochArray<Time>& labels, const EpochArray<Time>& prev_labels,
+                              const node_id_t& target_id, const size_t& round) :
+                m_labels {labels}, m_prev_labels {prev_labels}, m_target_id {target_id}, m_round {round} {}
 
-        if (stop_is_marked[stop_id]) {
-            for (const auto& route_id: stop.routes) {
-                const auto& route_iter = queue.find(route_id);
+        const size_t& round() const { return m_round; }
 
-                // Check if there is already a pair (r, p) in the queue
-                if (route_iter != queue.end()) {
-                    const auto& p = route_iter->second;
+        const Time& operator[](const node_id_t& stop_id) const { return m_labels[stop_id]; }
 
-                    // If s comes before p, replace p by s
-                    if (check_stops_order(route_id, stop_id, p)) {
-                        queue[route_id] = stop_id;
-                    }
-                } else {
-                    // If r is not in the queue, add (r, s) to the queue
-                    queue[route_id] = stop_id;
-                }
-            }
+        // The arrival time beyond which the journeys are pruned
+        const Time& bound() const { return m_labels[m_target_id]; }
+
+        const Time& prev(const node_id_t& stop_id) const { return m_prev_labels[stop_id]; }
+
+        void set(const node_id_t& stop_id, const Time& t) { m_labels.set(stop_id, t); }
+    };
+
+    // The labels of one round, the earliest arrival times using at most as many trips as the round,
+    // and the earliest arrival times using one trip less. The journeys are pruned either by the arrival time
+    // at a single target in this round, or by a fixed bound if there is no target or several targets.
+    class RoundView {
+    private:
+        RoundLabels<Time>& m_labels;
+        const size_t m_round;
+        const node_id_t m_target_id;
+        const Time m_bound;
+
+    public:
+        RoundView(RoundLabels<Time>& labels, const size_t& round, const node_id_t& target_id) :
+                m_labels {labels}, m_round {round}, m_target_id {target_id}, m_bound {} {}
+
+        RoundView(RoundLabels<Time>& labels, const size_t& round, const Time& bound) :
+                m_labels {labels}, m_round {round}, m_target_id {NULL_STOP}, m_bound {bound} {}
+
+        const size_t& round() const { return m_round; }
+
+        const Time& operator[](const node_id_t& stop_id) const { return m_labels(m_round, stop_id); }
+
+        const Time& bound() const { return m_target_id == NULL_STOP ? m_bound : m_labels(m_round, m_target_id); }
+
+        const Time& prev(const node_id_t& stop_id) const { return m_labels(m_round - 1, stop_id); }
+
+        void set(const node_id_t& stop_id, const Time& t) { m_labels.improve(m_round, stop_id, t); }
+    };
+}
+
+
+// Build the queue of routes serving the marked stops, then unmark the stops
+const RouteQueue& Raptor::make_queue() {
+    PROFILE_SCOPE(make_queue);
+
+    queue.clear();
+
+    for (const auto& stop_id: marked_stops.members()) {
+        const auto& stop = m_timetable->stops[stop_id];
+
+        // A route visiting the stop several times is added at its earliest visit
+        for (const auto& stop_route: m_timetable->routes_of(stop)) {
+            queue.add(stop_route.route_id, stop_route.stop_idx);
         }
     }
 
-    stop_is_marked.assign(stop_is_marked.size(), false);
+    marked_stops.clear();
+
+    if (m_round_stats != nullptr) {
+        m_round_stats->queued_routes = static_cast<uint32_t>(queue.routes().size());
+    }
 
     return queue;
 }
 
 
-// Find the earliest trip in route r that one can catch at stop s in round k,
-// i.e., the earliest trip t such that t_dep(t, s) >= t_(k-1) (s),
-// or the latest trip t such that t_arr(t, s) <= t_(k-1) (s) if the query is backward
-trip_id_t Raptor::earliest_trip(const route_id_t& route_id, const size_t& stop_idx, const Time& t) {
-    #ifdef PROFILE
-    Profiler prof {__func__};
-    #endif
+// Find the earliest trip among the first n_trips trips of the route that one can catch at the stop
+// at position stop_idx in round k, i.e., the earliest trip t such that t_dep(t, s) >= t_(k-1) (s).
+// The trips are given by their position in the route, and n_trips is returned if there is no such trip.
+size_t Raptor::earliest_trip(const Route& route, const size_t& stop_idx, const Time& t, const size_t& n_trips) {
+    PROFILE_SCOPE(earliest_trip);
 
-    const auto& stop_events = m_timetable->routes[route_id].stop_times_by_stops[stop_idx];
-    const auto& iter = std::lower_bound(stop_events.begin(), stop_events.end(), t,
-                                        [&](const StopTime& st, const Time& t) { return st.dep < t; });
+    const auto& departures = m_timetable->departures_of_stop(route, stop_idx);
+    const auto value = t.val() - departures.shift;
 
-    const auto& distance = static_cast<size_t>(iter - stop_events.begin());
-    const auto& trip_id = m_timetable->routes[route_id].trips[distance];
-    trip_id_t earliest_trip = iter == stop_events.end() ? NULL_TRIP : trip_id;
+    // Without a trip to improve on, the whole column is searched
+    if (n_trips == route.n_trips) return search::first_at_or_after(departures.values.begin(), n_trips, value);
 
-    return earliest_trip;
+    // A slightly earlier arrival at a stop usually catches the same trip or one of the previous ones,
+    // so we step back over a few trips before searching the remaining ones
+    size_t pos = n_trips;
+    for (size_t step = 0; step < 4 && pos > 0; ++step, --pos) {
+        if (departures.values[pos - 1] < value) return pos;
+    }
+
+    return search::first_at_or_after(departures.values.begin(), pos, value);
 }
 
 
-std::vector<Time> Raptor::query(const node_id_t& source_id, const node_id_t& target_id, const Time& departure_time) {
-    std::vector<Time> target_labels;
+// Traverse each route in the queue, and mark the stops whose labels are improved. The current trip is
+// given by its position in the route, so that its stop events are read without looking up the trip.
+template<class Labels>
+void Raptor::scan_routes(Labels& labels) {
+    stops_improved = false;
+
+    // The work is counted in local variables, and only added to the statistics at the end
+    uint32_t n_visited_events = 0;
+    uint32_t n_earliest_trip_calls = 0;
+    uint32_t n_improved_labels = 0;
+
+    for (const auto& route_id: queue.routes()) {
+        const auto& route = m_timetable->routes[route_id];
+
+        const auto& route_stops = m_timetable->stops_of(route);
+        size_t trip_pos = route.n_trips;
+        const StopTime* trip_stop_times = nullptr;
+        Time::value_type trip_offset = 0;
+        size_t board_idx = 0;
+        size_t stop_idx = queue.stop_idx(route_id);
+
+        // Iterate over the stops of the route beginning with stop_id
+        for (size_t i = stop_idx; i < route_stops.size(); ++i) {
+            node_id_t p_i = route_stops[i];
+            Time dep;
+
+            if (trip_stop_times != nullptr) {
+                // Get the departure and arrival time of the current trip at the stop p_i
+                const Time arr {trip_stop_times[i].arr.val() + trip_offset};
+                dep = Time(trip_stop_times[i].dep.val() + trip_offset);
+                ++n_visited_events;
+
+                // Local and target pruning
+                if (arr < std::min(labels[p_i], labels.bound())) {
+                    labels.set(p_i, arr);
+                    marked_stops.insert(p_i);
+                    stops_improved = true;
+                    ++n_improved_labels;
+
+                    if (record_journeys) {
+                        const auto& t = m_timetable->trips_of(route)[trip_pos];
+                        set_parent(labels.round(), p_i, Parent {t, static_cast<uint32_t>(board_idx), NULL_STOP});
+                    }
+                }
+            }
+
+            // Check if we can catch an earlier trip at p_i
+            const auto& prev_label = labels.prev(p_i);
+            if (prev_label && prev_label <= dep) {
+                const auto earliest_pos = earliest_trip(route, i, prev_label, trip_pos);
+                ++n_earliest_trip_calls;
+
+                if (earliest_pos < trip_pos) {
+                    trip_pos = earliest_pos;
+                    trip_stop_times = m_timetable->trip_row(route, trip_pos);
+                    trip_offset = m_timetable->trip_offset(route, trip_pos);
+                }
+
+                board_idx = i;
+            }
+        }
+    }
+
+    if (m_round_stats != nullptr) {
+        m_round_stats->visited_events += n_visited_events;
+        m_round_stats->earliest_trip_calls += n_earliest_trip_calls;
+        m_round_stats->improved_labels += n_improved_labels;
+    }
+}
+
+
+void Raptor::begin_query(const node_id_t& source_id, const node_id_t& target_id, const Time& departure_time,
+                         QueryStats* stats) {
+    // Initialisation, the labels of the previous query are discarded by starting a new epoch
+    earliest_arrival_time.reset();
+    prev_earliest_arrival_time.reset();
+    tmp_hub_labels.reset();
+    marked_stops.clear();
+    reset_parents();
 
-    // Initialisation
-    earliest_arrival_time[source_id] = {departure_time};
-    prev_earliest_arrival_time[source_id] = {departure_time};
+    m_source_id = source_id;
+    m_target_id = target_id;
+    m_departure_time = departure_time;
+    m_labels_by_round = false;
+    m_round = 0;
+    m_query_stats = stats;
+    m_round_stats = nullptr;
 
-    stop_is_marked[source_id] = true;
+    earliest_arrival_time.set(source_id, departure_time);
+    prev_earliest_arrival_time.set(source_id, departure_time);
+
+    marked_stops.insert(source_id);
 
     // If walking is unlimited, we can have a pure walking journey from the source to the target.
     // But in the case of profile queries, we need journeys to contain at least one trip, i.e.,
@@ -89,100 +233,104 @@ std::vector<Time> Raptor::query(const node_id_t& source_id, const node_id_t& tar
     if (use_hl && !profile) {
         auto target_arrival_time = departure_time + m_timetable->walking_time(source_id, target_id);
 
-        earliest_arrival_time[target_id] = target_arrival_time;
+        earliest_arrival_time.set(target_id, target_arrival_time);
+
+        if (record_journeys) {
+            set_walk_parent(0, target_id, source_id);
+        }
     }
+}
 
-    target_labels.push_back(earliest_arrival_time[target_id]);
 
-    uint16_t round {0};
-    while (true) {
-        ++round;
+// First stage, begin the next round by copying the earliest arrival times of the marked stops to the previous round
+void Raptor::copy_labels() {
+    PROFILE_SCOPE(copy_labels);
 
-        #ifdef PROFILE
-        auto* prof_1 = new Profiler {"stage 1"};
-        #endif
+    ++m_round;
 
-        // First stage, copy the earliest arrival times to the previous round
-        for (const auto& stop: m_timetable->stops) {
-            if (stop_is_marked[stop.id]) {
-                prev_earliest_arrival_time[stop.id] = earliest_arrival_time[stop.id];
-            }
-        }
+    if (m_query_stats != nullptr) {
+        m_query_stats->emplace_back();
+        m_round_stats = &m_query_stats->back();
+        m_round_stats->marked_stops = static_cast<uint32_t>(marked_stops.size());
+    }
 
-        #ifdef PROFILE
-        delete prof_1;
-        #endif
-
-        // Second stage
-        auto queue = make_queue();
-        stops_improved = false;
-
-        #ifdef PROFILE
-        auto* prof_2 = new Profiler {"traverse routes"};
-        #endif
-
-        // Traverse each route
-        for (const auto& route_stop: queue) {
-            const auto& route_id = route_stop.first;
-            const auto& stop_id = route_stop.second;
-            auto& route = m_timetable->routes[route_id];
-
-            trip_id_t t = NULL_TRIP;
-            size_t stop_idx = route.stop_positions[stop_id];
-
-            // Iterate over the stops of the route beginning with stop_id
-            for (size_t i = stop_idx; i < route.stops.size(); ++i) {
-                node_id_t p_i = route.stops[i];
-                Time dep, arr;
-
-                if (t != NULL_TRIP) {
-                    // Get the position of the trip t
-                    trip_pos_t trip_pos = m_timetable->trip_positions[t];
-                    size_t pos = trip_pos.second;
-
-                    // Get the departure and arrival time of the trip t at the stop p_i
-                    dep = route.stop_times_by_trips[pos][i].dep;
-                    arr = route.stop_times_by_trips[pos][i].arr;
-
-                    // Local and target pruning
-                    if (arr < std::min(earliest_arrival_time[p_i], earliest_arrival_time[target_id])) {
-                        earliest_arrival_time[p_i] = arr;
-                        stop_is_marked[p_i] = true;
-                        stops_improved = true;
-                    }
-                }
+    for (const auto& stop_id: marked_stops.members()) {
+        prev_earliest_arrival_time.set(stop_id, earliest_arrival_time[stop_id]);
+    }
+}
 
-                // Check if we can catch an earlier trip at p_i
-                if (prev_earliest_arrival_time[p_i] <= dep) {
-                    t = earliest_trip(route_id, i, prev_earliest_arrival_time[p_i]);
-                }
-            }
-        }
 
-        #ifdef PROFILE
-        delete prof_2;
-        #endif
+// Second stage, scan the routes in the queue built by make_queue
+bool Raptor::scan_round_routes() {
+    PROFILE_SCOPE(traverse_routes);
 
-        target_labels.push_back(earliest_arrival_time[target_id]);
-        if (!stops_improved) break;
+    EarliestArrivalLabels labels {earliest_arrival_time, prev_earliest_arrival_time, m_target_id, m_round};
+    scan_routes(labels);
+
+    // In the first round, we need to consider also the transfers starting from the source,
+    // this was not considered in the original version of RAPTOR. They are scanned even if
+    // no route improves any stop, e.g., when no trip leaves the source after the departure time.
+    return stops_improved || (m_round == 1 && !profile);
+}
+
+
+// Third stage, look at footpaths
+void Raptor::scan_round_footpaths() {
+    EarliestArrivalLabels labels {earliest_arrival_time, prev_earliest_arrival_time, m_target_id, m_round};
+    const bool walk_from_source = m_round == 1 && !profile;
+
+    if (walk_from_source) {
+        marked_stops.insert(m_source_id);
+    }
+
+    scan_footpaths(labels);
+
+    // After having scanned the transfers/foot paths, we remove source_id
+    // from the set of marked stops. Leaving it there would change nothing,
+    // as we already marked it in the initialisation step, and scanning the routes
+    // starting from source_id again is just a duplication of what was already done
+    // in the first round.
+    if (walk_from_source) {
+        marked_stops.erase(m_source_id);
+    }
+}
+
+
+std::vector<Time> Raptor::query(const node_id_t& source_id, const node_id_t& target_id, const Time& departure_time,
+                                QueryStats* stats) {
+    std::vector<Time> target_labels;
+
+    begin_query(source_id, target_id, departure_time, stats);
+
+    const auto counters = m_perf_counters.get();
+    m_phase_counts.fill(perf::Sample());
+
+    target_labels.push_back(earliest_arrival_time[target_id]);
 
-        // Third stage, look at footpaths
+    while (true) {
+        {
+            PerfScope scope {counters, m_phase_counts[phase::copy_labels]};
+            copy_labels();
+        }
 
-        // In the first round, we need to consider also the transfers starting from the source,
-        // this was not considered in the original version of RAPTOR
-        if (round == 1 && !profile) {
-            stop_is_marked[source_id] = true;
+        {
+            PerfScope scope {counters, m_phase_counts[phase::make_queue]};
+            make_queue();
         }
 
-        scan_footpaths(target_id);
+        bool scan_footpaths;
+        {
+            PerfScope scope {counters, m_phase_counts[phase::traverse_routes]};
+            scan_footpaths = scan_round_routes();
+        }
+
+        target_labels.push_back(earliest_arrival_time[target_id]);
+
+        if (!scan_footpaths) break;
 
-        // After having scanned the transfers/foot paths, we remove source_id
-        // from the set of marked stops. Leaving it there would change nothing,
-        // as we already marked it in the initialisation step, and scanning the routes
-        // starting from source_id again is just a duplication of what was already done
-        // in the first round.
-        if (round == 1 && !profile) {
-            stop_is_marked[source_id] = false;
+        {
+            PerfScope scope {counters, m_phase_counts[phase::scan_footpaths]};
+            scan_round_footpaths();
         }
 
         // The earliest arrival time at target_id could have been changed
@@ -191,106 +339,473 @@ std::vector<Time> Raptor::query(const node_id_t& source_id, const node_id_t& tar
         target_labels.back() = earliest_arrival_time[target_id];
     }
 
+    m_query_stats = nullptr;
+    m_round_stats = nullptr;
+
     return target_labels;
 }
 
 
-void Raptor::scan_footpaths(const node_id_t& target_id) {
+template<class Labels>
+void Raptor::scan_footpaths(Labels& labels) {
+    PROFILE_SCOPE(scan_footpaths);
+
     Time tmp_time;
-    static std::unordered_set<node_id_t> improved_stops_or_hubs;
+    uint32_t n_relaxed_edges = 0;
+    uint32_t n_improved_labels = 0;
 
     if (!use_hl) {
-        for (const auto& stop: m_timetable->stops) {
-            const auto& stop_id = stop.id;
+        // The footpaths start from the arrival times given by the routes, so we keep them aside
+        // before any of them is improved by another footpath, otherwise the result would depend
+        // on the order in which the marked stops are scanned
+        const auto n_marked_stops = marked_stops.size();
+        marked_stops_labels.clear();
+        for (const auto& stop_id: marked_stops.members()) {
+            marked_stops_labels.push_back(labels[stop_id]);
+        }
+
+        // The stops improved by the footpaths are added at the end of the marked stops,
+        // they are not scanned in this loop
+        for (size_t i = 0; i < n_marked_stops; ++i) {
+            const auto stop_id = marked_stops.members()[i];
 
-            if (stop_is_marked[stop_id]) {
-                for (const auto& transfer: m_timetable->stops[stop_id].transfers) {
-                    const auto& dest_id = transfer.dest;
-                    const auto& transfer_time = transfer.time;
+            for (const auto& transfer: m_timetable->transfers_of(m_timetable->stops[stop_id])) {
+                const auto& dest_id = transfer.dest;
+                const auto& transfer_time = transfer.time;
 
-                    tmp_time = earliest_arrival_time[stop_id] + transfer_time;
+                tmp_time = marked_stops_labels[i] + transfer_time;
+                ++n_relaxed_edges;
 
-                    if (tmp_time < earliest_arrival_time[dest_id]) {
-                        earliest_arrival_time[dest_id] = tmp_time;
-                        improved_stops_or_hubs.insert(dest_id);
+                if (tmp_time < labels[dest_id]) {
+                    labels.set(dest_id, tmp_time);
+                    marked_stops.insert(dest_id);
+                    ++n_improved_labels;
+
+                    if (record_journeys) {
+                        set_walk_parent(labels.round(), dest_id, stop_id);
                     }
+                }
 
-                    // Since the transfers are sorted in the increasing order of walking time,
-                    // we can skip the scanning of the transfers as soon as the arrival time
-                    // of the destination is later than that of the target
-                    if (tmp_time > earliest_arrival_time[target_id]) break;
+                // Since the transfers are sorted in the increasing order of walking time,
+                // we can skip the scanning of the transfers as soon as the arrival time
+                // of the destination is later than that of the target
+                if (tmp_time > labels.bound()) break;
+            }
+        }
+    } else {
+        // The walks go from the marked stops to their out-hubs, then from the hubs to the stops
+        // having them as in-hubs. The first phase only touches the hubs, so the marked stops are those
+        // improved by the routes, and the second phase only scans the hubs improved in the first one.
+        for (const auto& stop_id: marked_stops.members()) {
+            const auto stop_label = labels[stop_id];
+
+            for (const auto& kv: m_timetable->out_hubs_of(m_timetable->stops[stop_id])) {
+                const auto& walking_time = kv.first;
+                const auto& hub_id = kv.second;
+
+                tmp_time = stop_label + walking_time;
+                ++n_relaxed_edges;
+
+                // Since we sort the links stop->out-hub in the increasing order of walking time,
+                // as soon as the arrival time propagated to a hub is after the earliest arrival time
+                // at the target, there is no need to propagate to the next hubs
+                if (tmp_time > labels.bound()) break;
+
+                if (tmp_time < tmp_hub_labels[hub_id]) {
+                    tmp_hub_labels.set(hub_id, tmp_time);
+                    improved_hubs.insert(hub_id);
+
+                    if (record_journeys) {
+                        hub_parents.set(hub_id, stop_id);
+                    }
                 }
             }
         }
 
-        for (const auto& stop_id: improved_stops_or_hubs) {
-            stop_is_marked[stop_id] = true;
-        }
-    } else {
-        for (const auto& stop: m_timetable->stops) {
-            const auto& stop_id = stop.id;
+        for (const auto& hub_id: improved_hubs.members()) {
+            const auto hub_label = tmp_hub_labels[hub_id];
 
-            if (stop_is_marked[stop_id]) {
-                for (const auto& kv: m_timetable->stops[stop_id].out_hubs) {
-                    const auto& walking_time = kv.first;
-                    const auto& hub_id = kv.second;
+            // The links hub->stop are also sorted in the increasing order of walking time
+            for (const auto& kv: m_timetable->inverse_in_hubs_of(hub_id)) {
+                const auto& walking_time = kv.first;
+                const auto& stop_id = kv.second;
 
-                    tmp_time = earliest_arrival_time[stop_id] + walking_time;
+                tmp_time = hub_label + walking_time;
+                ++n_relaxed_edges;
+                if (tmp_time > labels.bound()) break;
 
-                    // Since we sort the links stop->out-hub in the increasing order of walking time,
-                    // as soon as the arrival time propagated to a hub is after the earliest arrival time
-                    // at the target, there is no need to propagate to the next hubs
-                    if (tmp_time > earliest_arrival_time[target_id]) break;
+                if (tmp_time < labels[stop_id]) {
+                    labels.set(stop_id, tmp_time);
+                    marked_stops.insert(stop_id);
+                    ++n_improved_labels;
 
-                    if (tmp_time < tmp_hub_labels[hub_id]) {
-                        tmp_hub_labels[hub_id] = tmp_time;
-                        improved_stops_or_hubs.insert(hub_id);
+                    if (record_journeys) {
+                        set_walk_parent(labels.round(), stop_id, hub_parents[hub_id]);
                     }
                 }
             }
         }
 
-        for (const auto& hub_id: improved_stops_or_hubs) {
-            // We need to check if hub_id, which is the out-hub of some stop,
-            // is the in-hub of some other stop
-            if (m_timetable->inverse_in_hubs[hub_id].empty()) {
-                for (const auto& kv: m_timetable->inverse_in_hubs[hub_id]) {
-                    const auto& walking_time = kv.first;
-                    const auto& stop_id = kv.second;
+        improved_hubs.clear();
+    }
 
-                    tmp_time = tmp_hub_labels[hub_id] + walking_time;
-                    if (tmp_time > earliest_arrival_time[target_id]) break;
+    if (m_round_stats != nullptr) {
+        m_round_stats->relaxed_edges += n_relaxed_edges;
+        m_round_stats->improved_labels += n_improved_labels;
+    }
+}
 
-                    if (tmp_time < earliest_arrival_time[stop_id]) {
-                        earliest_arrival_time[stop_id] = tmp_time;
-                        stop_is_marked[stop_id] = true;
-                    }
+
+// Run the rounds from the source leaving at the departure time, the labels of all the rounds are improved
+// in place. The search is pruned by the arrival times at the targets, there is no pruning without target.
+void Raptor::run(const node_id_t& source_id, const Time& departure_time, const std::vector<node_id_t>& targets) {
+    // A single target gives the tightest bound, which improves during the round. With several targets,
+    // the bound is the latest arrival time at the targets at the beginning of the round.
+    auto round_view = [&](const size_t& round) -> RoundView {
+        if (targets.size() == 1) return RoundView {round_labels, round, targets.front()};
+
+        Time bound = targets.empty() ? Time() : Time(Time::neg_inf);
+        for (const auto& target_id: targets) {
+            bound = std::max(bound, round_labels(round, target_id));
+        }
+
+        return RoundView {round_labels, round, bound};
+    };
+
+    tmp_hub_labels.reset();
+    marked_stops.clear();
+
+    m_source_id = source_id;
+    m_departure_time = departure_time;
+    m_labels_by_round = true;
+
+    // The source and the stops reachable by walking from the source are reached in round 0
+    auto initial_labels = round_view(0);
+    initial_labels.set(source_id, departure_time);
+    marked_stops.insert(source_id);
+    scan_footpaths(initial_labels);
+
+    for (size_t round = 1; !marked_stops.empty(); ++round) {
+        round_labels.add_rounds(round);
+        auto labels = round_view(round);
+
+        make_queue();
+        scan_routes(labels);
+
+        if (!stops_improved) break;
+
+        scan_footpaths(labels);
+    }
+}
+
+
+// Add the departure times from the source of the trips leaving the stop, which is reached by walking from the source
+void Raptor::collect_departures(const node_id_t& stop_id, const Time& walking_time,
+                                const Time& earliest_dep, const Time& latest_dep,
+                                std::vector<Time>& departures) const {
+    for (const auto& stop_route: m_timetable->routes_of(m_timetable->stops[stop_id])) {
+        const auto& route = m_timetable->routes[stop_route.route_id];
+        const auto& stop_idx = stop_route.stop_idx;
+
+        // No trip can be boarded at the last stop of the route
+        if (stop_idx + 1 >= route.n_stops) continue;
+
+        const auto& column = m_timetable->departures_of_stop(route, stop_idx);
+
+        for (const auto& value: column.values) {
+            Time departure_time {value + column.shift - walking_time.val()};
+
+            if (earliest_dep <= departure_time && departure_time <= latest_dep) {
+                departures.push_back(departure_time);
+            }
+        }
+    }
+}
+
+
+std::vector<Journey> Raptor::range_query(const node_id_t& source_id, const node_id_t& target_id,
+                                         const Time& earliest_dep, const Time& latest_dep) {
+    std::vector<Journey> journeys;
+    std::vector<Time> departures;
+    std::vector<Time> prev_target_labels;
+
+    // A journey can only leave the source at the departure time of a trip from the source, or from a stop
+    // reachable by walking from the source, minus the walking time. With hub labelling, the stops reachable
+    // by walking are those having an out-hub of the source as in-hub, and the walking time to a stop
+    // is the shortest walk through any of these hubs.
+    collect_departures(source_id, Time(0), earliest_dep, latest_dep, departures);
+
+    if (!use_hl) {
+        for (const auto& transfer: m_timetable->transfers_of(m_timetable->stops[source_id])) {
+            collect_departures(transfer.dest, transfer.time, earliest_dep, latest_dep, departures);
+        }
+    } else {
+        std::vector<std::pair<node_id_t, Time>> walks;
+
+        for (const auto& out_hub: m_timetable->out_hubs_of(m_timetable->stops[source_id])) {
+            for (const auto& kv: m_timetable->inverse_in_hubs_of(out_hub.second)) {
+                if (kv.second != source_id) walks.emplace_back(kv.second, out_hub.first + kv.first);
+            }
+        }
+
+        // Keep the shortest walk to each stop
+        std::sort(walks.begin(), walks.end(), [](const std::pair<node_id_t, Time>& w1,
+                                                 const std::pair<node_id_t, Time>& w2) {
+            return w1.first < w2.first || (w1.first == w2.first && w1.second < w2.second);
+        });
+
+        for (size_t i = 0; i < walks.size(); ++i) {
+            if (i == 0 || walks[i].first != walks[i - 1].first) {
+                collect_departures(walks[i].first, walks[i].second, earliest_dep, latest_dep, departures);
+            }
+        }
+    }
+
+    // The departures are scanned from the latest to the earliest one, and the labels are kept from one run
+    // to the next, since arriving somewhere by leaving later is also possible by leaving earlier and waiting.
+    // A run then only explores the journeys improved by leaving earlier.
+    std::sort(departures.begin(), departures.end(), [](const Time& t1, const Time& t2) { return t1 > t2; });
+    departures.erase(std::unique(departures.begin(), departures.end()), departures.end());
+
+    const std::vector<node_id_t> targets {target_id};
+
+    round_labels.reset();
+    round_labels.add_rounds(0);
+    reset_parents();
+
+    for (const auto& departure_time: departures) {
+        prev_target_labels.clear();
+        for (size_t round = 0; round < round_labels.n_rounds(); ++round) {
+            prev_target_labels.push_back(round_labels(round, target_id));
+        }
+
+        run(source_id, departure_time, targets);
+
+        // A journey with k trips is found if the run improves the arrival time at the target in round k,
+        // and if it arrives earlier than all the journeys with fewer trips
+        for (size_t round = 1; round < round_labels.n_rounds(); ++round) {
+            const auto& arrival_time = round_labels(round, target_id);
+            const auto& prev_arrival_time = prev_target_labels[std::min(round, prev_target_labels.size() - 1)];
+
+            if (arrival_time < prev_arrival_time && arrival_time < round_labels(round - 1, target_id)) {
+                journeys.emplace_back(departure_time, arrival_time, static_cast<uint16_t>(round - 1));
+
+                if (record_journeys) {
+                    journeys.back().legs = journey(target_id, round);
                 }
             }
         }
     }
 
-    improved_stops_or_hubs.clear();
+    std::sort(journeys.begin(), journeys.end(), [](const Journey& j1, const Journey& j2) {
+        return j1.dep < j2.dep || (j1.dep == j2.dep && j1.n_transfers < j2.n_transfers);
+    });
+
+    return journeys;
 }
 
 
-void Raptor::init() {
-    stop_is_marked.assign(m_timetable->max_stop_id + 1, false);
-    earliest_arrival_time.resize(m_timetable->max_stop_id + 1);
-    prev_earliest_arrival_time.resize(m_timetable->max_stop_id + 1);
+const RoundLabels<Time>& Raptor::one_to_all(const node_id_t& source_id, const Time& departure_time) {
+    round_labels.reset();
+    round_labels.add_rounds(0);
+    reset_parents();
+
+    run(source_id, departure_time, {});
+
+    return round_labels;
+}
+
 
-    if (use_hl) {
-        tmp_hub_labels.resize(m_timetable->max_node_id + 1);
+std::vector<std::vector<Time>> Raptor::many_to_many(const std::vector<node_id_t>& source_ids,
+                                                    const std::vector<node_id_t>& target_ids,
+                                                    const Time& departure_time) {
+    std::vector<std::vector<Time>> travel_times;
+
+    // One search from each source gives the travel times to all the targets,
+    // the search stops as soon as it cannot improve the arrival time at any target
+    for (const auto& source_id: source_ids) {
+        round_labels.reset();
+        round_labels.add_rounds(0);
+        reset_parents();
+
+        run(source_id, departure_time, target_ids);
+
+        travel_times.emplace_back();
+        for (const auto& target_id: target_ids) {
+            const auto& arrival_time = round_labels(round_labels.n_rounds() - 1, target_id);
+
+            travel_times.back().push_back(arrival_time ? arrival_time - departure_time : Time());
+        }
     }
+
+    return travel_times;
 }
 
 
-void Raptor::clear() {
-    stop_is_marked.clear();
-    earliest_arrival_time.clear();
-    prev_earliest_arrival_time.clear();
+void Raptor::reset_parents() {
+    if (!record_journeys) return;
 
-    if (use_hl) {
-        tmp_hub_labels.clear();
+    for (auto& round_parents: parents) {
+        round_parents.reset();
     }
+
+    hub_parents.reset();
+}
+
+
+void Raptor::set_parent(const size_t& round, const node_id_t& stop_id, const Parent& parent) {
+    while (parents.size() <= round) {
+        parents.emplace_back();
+        parents.back().resize(m_timetable->max_stop_id + 1);
+    }
+
+    parents[round].set(stop_id, parent);
+}
+
+
+void Raptor::set_walk_parent(const size_t& round, const node_id_t& stop_id, const node_id_t& walked_from) {
+    Parent parent = round < parents.size() ? parents[round][stop_id] : Parent();
+    parent.walked_from = walked_from;
+
+    set_parent(round, stop_id, parent);
+}
+
+
+// The round in which the stop got the label it has at the end of the given round, or NULL_ROUND if it is not reached
+size_t Raptor::parent_round(const node_id_t& stop_id, const size_t& round) const {
+    size_t parent_round = std::min(round, parents.size() - 1);
+
+    if (m_labels_by_round) {
+        // The labels of the later rounds are lowered with the label of the round in which it is improved,
+        // so the earliest round with the same label is the one in which the parent was recorded
+        const auto& label = round_labels(std::min(round, round_labels.n_rounds() - 1), stop_id);
+        if (!label) return NULL_ROUND;
+
+        while (parent_round > 0 && round_labels(parent_round - 1, stop_id) == label) {
+            --parent_round;
+        }
+
+        return parents[parent_round].is_set(stop_id) ? parent_round : NULL_ROUND;
+    }
+
+    // The earliest arrival times are overwritten in each round, so the parent is the last one recorded
+    while (!parents[parent_round].is_set(stop_id)) {
+        if (parent_round == 0) return NULL_ROUND;
+        --parent_round;
+    }
+
+    return parent_round;
+}
+
+
+std::vector<Leg> Raptor::journey(const node_id_t& target_id, const size_t& round) const {
+    std::vector<Leg> legs;
+
+    if (!record_journeys || parents.empty()) return legs;
+
+    // The positions in their route of the stops where the trips are boarded
+    std::vector<size_t> board_idx;
+
+    // Follow the parents from the target back to the source
+    node_id_t stop_id = target_id;
+    size_t current_round = round;
+
+    // After walking to a stop, the footpath starts from the arrival time of the trip
+    // which reached the previous stop in the same round
+    bool walked = false;
+
+    while (stop_id != m_source_id) {
+        const auto parent_idx = walked ? current_round : parent_round(stop_id, current_round);
+        if (parent_idx == NULL_ROUND || !parents[parent_idx].is_set(stop_id)) return {};
+
+        const auto& parent = parents[parent_idx][stop_id];
+
+        if (!walked && parent.walked_from != NULL_STOP) {
+            legs.emplace_back(parent.walked_from, stop_id, NULL_TRIP);
+            board_idx.push_back(0);
+            stop_id = parent.walked_from;
+            current_round = parent_idx;
+            walked = true;
+        } else {
+            if (parent.trip == NULL_TRIP) return {};
+
+            const auto& route = m_timetable->routes[m_timetable->trip_positions[parent.trip].first];
+
+            legs.emplace_back(m_timetable->stops_of(route)[parent.board_idx], stop_id, parent.trip);
+            board_idx.push_back(parent.board_idx);
+            stop_id = legs.back().from;
+            walked = false;
+
+            // The trip is boarded with the label of the previous round
+            if (parent_idx == 0) return {};
+            current_round = parent_idx - 1;
+        }
+    }
+
+    std::reverse(legs.begin(), legs.end());
+    std::reverse(board_idx.begin(), board_idx.end());
+
+    // The times of the legs are given by the timetable, walking as soon as possible
+    Time time = m_departure_time;
+
+    for (size_t i = 0; i < legs.size(); ++i) {
+        auto& leg = legs[i];
+
+        if (leg.trip == NULL_TRIP) {
+            leg.dep = time;
+            leg.arr = time + walking_time(leg.from, leg.to);
+        } else {
+            const auto& trip_pos = m_timetable->trip_positions[leg.trip];
+            const auto& route = m_timetable->routes[trip_pos.first];
+            const auto& route_stops = m_timetable->stops_of(route);
+
+            // The trip is left at the first appearance of the stop after the boarding stop
+            size_t alight_idx = board_idx[i] + 1;
+            while (route_stops[alight_idx] != leg.to) ++alight_idx;
+
+            leg.dep = m_timetable->stop_time(route, trip_pos.second, board_idx[i]).dep;
+            leg.arr = m_timetable->stop_time(route, trip_pos.second, alight_idx).arr;
+        }
+
+        time = leg.arr;
+    }
+
+    return legs;
+}
+
+
+Time Raptor::walking_time(const node_id_t& from_id, const node_id_t& to_id) const {
+    if (use_hl) return m_timetable->walking_time(from_id, to_id);
+
+    for (const auto& transfer: m_timetable->transfers_of(m_timetable->stops[from_id])) {
+        if (transfer.dest == to_id) return transfer.time;
+    }
+
+    return {};
+}
+
+
+std::vector<std::vector<Time>> parallel_many_to_many(const Timetable* timetable,
+                                                     const std::vector<node_id_t>& source_ids,
+                                                     const std::vector<node_id_t>& target_ids,
+                                                     const Time& departure_time, const size_t& n_threads) {
+    // A few sources per task, since a search is long enough to make the scheduling negligible
+    static const size_t chunk_size = 4;
+
+    std::vector<std::vector<Time>> travel_times(source_ids.size());
+    std::vector<std::unique_ptr<Raptor>> engines(default_n_threads(n_threads));
+
+    parallel_for(source_ids.size(), chunk_size, n_threads, [&](size_t thread_idx, size_t begin, size_t end) {
+        auto& raptor = engines[thread_idx];
+        if (!raptor) raptor.reset(new Raptor {timetable});
+
+        const std::vector<node_id_t> chunk_source_ids {source_ids.begin() + begin, source_ids.begin() + end};
+        auto chunk_travel_times = raptor->many_to_many(chunk_source_ids, target_ids, departure_time);
+
+        for (size_t i = begin; i < end; ++i) {
+            travel_times[i] = std::move(chunk_travel_times[i - begin]);
+        }
+    });
+
+    return travel_times;
 }
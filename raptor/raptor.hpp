@@ -1,44 +1,340 @@
 #ifndef RAPTOR_HPP
 #define RAPTOR_HPP
 
+#include <algorithm> // std::find
+#include <array>
+#include <limits>
+#include <memory>
 #include <tuple>
-#include <unordered_map>
-#include <unordered_set>
 #include <utility> // std::pair
+#include <vector>
 
 #include "config.hpp"
 #include "data_structure.hpp"
+#include "labels.hpp"
+#include "perf_counters.hpp"
 
 
-using route_stop_queue_t = std::unordered_map<route_id_t, node_id_t>;
+// The routes to be scanned in a round, each with the position of its earliest marked stop.
+// The positions are stored in an array indexed by route, together with the list of queued routes,
+// so that adding a route and clearing the queue do not allocate once the queue has been used.
+class RouteQueue {
+private:
+    static const size_t not_queued = std::numeric_limits<size_t>::max();
+
+    std::vector<size_t> m_stop_idx;
+    std::vector<route_id_t> m_routes;
+
+public:
+    void resize(const size_t& n_routes) { m_stop_idx.assign(n_routes, not_queued); }
+
+    // Add (r, p) to the queue, or replace (r, p') by (r, p) if p comes before p' in the route
+    void add(const route_id_t& route_id, const size_t& stop_idx) {
+        auto& queued_stop_idx = m_stop_idx[route_id];
+
+        if (queued_stop_idx == not_queued) {
+            queued_stop_idx = stop_idx;
+            m_routes.push_back(route_id);
+        } else if (stop_idx < queued_stop_idx) {
+            queued_stop_idx = stop_idx;
+        }
+    }
+
+    const std::vector<route_id_t>& routes() const { return m_routes; }
+
+    // The position in the route of the earliest marked stop
+    const size_t& stop_idx(const route_id_t& route_id) const { return m_stop_idx[route_id]; }
+
+    void clear() {
+        for (const auto& route_id: m_routes) {
+            m_stop_idx[route_id] = not_queued;
+        }
+
+        m_routes.clear();
+    }
+};
+
+
+// A set of ids in [0, n) with constant time insertion and membership test. The members are also
+// kept in a list in the order of insertion, so that iterating over the set and clearing it
+// take a time linear in the number of members instead of n.
+class MarkedSet {
+private:
+    std::vector<bool> m_is_member;
+    std::vector<node_id_t> m_members;
+
+public:
+    void resize(const size_t& n) {
+        m_is_member.assign(n, false);
+        m_members.clear();
+    }
+
+    bool contains(const node_id_t& id) const { return m_is_member[id]; }
+
+    void insert(const node_id_t& id) {
+        if (!m_is_member[id]) {
+            m_is_member[id] = true;
+            m_members.push_back(id);
+        }
+    }
+
+    // Linear in the number of members, this should be rare
+    void erase(const node_id_t& id) {
+        if (m_is_member[id]) {
+            m_is_member[id] = false;
+            m_members.erase(std::find(m_members.begin(), m_members.end(), id));
+        }
+    }
+
+    const std::vector<node_id_t>& members() const { return m_members; }
+
+    size_t size() const { return m_members.size(); }
+
+    bool empty() const { return m_members.empty(); }
+
+    void clear() {
+        for (const auto& id: m_members) {
+            m_is_member[id] = false;
+        }
+
+        m_members.clear();
+    }
+};
+
+
+// How a stop is reached in a round: by the trip boarded at the position board_idx in its route,
+// then possibly by walking from another stop if walked_from is not NULL_STOP. The trip is kept
+// when the stop is improved by a footpath, since the footpaths leaving the stop in the same round
+// start from the arrival time of the trip.
+struct Parent {
+    trip_id_t trip;
+    uint32_t board_idx;
+    node_id_t walked_from;
+
+    Parent() : trip {NULL_TRIP}, board_idx {}, walked_from {NULL_STOP} {};
+
+    Parent(trip_id_t t, uint32_t b, node_id_t w) : trip {t}, board_idx {b}, walked_from {w} {};
+};
+
+
+// A leg of a journey, either on a trip or walking if trip is NULL_TRIP
+struct Leg {
+    node_id_t from;
+    node_id_t to;
+    trip_id_t trip;
+    Time dep;
+    Time arr;
+
+    Leg(node_id_t f, node_id_t t, trip_id_t tr) : from {f}, to {t}, trip {tr}, dep {}, arr {} {};
+};
+
+
+// A journey from the source to the target of a range query, which is not dominated by another journey
+// leaving later, arriving earlier, or having fewer transfers. The legs are only given if the journeys are recorded.
+// The total walking time is only given by the multi-criteria queries.
+struct Journey {
+    Time dep;
+    Time arr;
+    uint16_t n_transfers;
+    Time walking_time;
+    std::vector<Leg> legs;
+
+    Journey(const Time& d, const Time& a, uint16_t n, const Time& w = Time()) :
+            dep {d}, arr {a}, n_transfers {n}, walking_time {w} {};
+};
+
+
+// The work done by an earliest arrival query in one round: the stops marked at the beginning of the round,
+// the routes scanned, the stop events read from the trips, the searches of the earliest trip,
+// the footpaths or hub links relaxed, and the labels improved by the routes and the footpaths
+struct RoundStats {
+    uint32_t marked_stops = 0;
+    uint32_t queued_routes = 0;
+    uint32_t visited_events = 0;
+    uint32_t earliest_trip_calls = 0;
+    uint32_t relaxed_edges = 0;
+    uint32_t improved_labels = 0;
+};
+
+
+// The work done by a query, one element per round
+using QueryStats = std::vector<RoundStats>;
+
+
+// The phases of the rounds of an earliest arrival query, in which the hardware events are counted
+namespace phase {
+    enum Phase : size_t {
+        copy_labels,
+        make_queue,
+        traverse_routes,
+        scan_footpaths,
+        n_phases
+    };
+
+    inline const char* name(const size_t& phase) {
+        static const char* const names[n_phases] = {"copy_labels", "make_queue", "traverse_routes", "scan_footpaths"};
+
+        return names[phase];
+    }
+}
+
+
+// The hardware events of a query in each phase, summed over the rounds
+using PhaseCounts = std::array<perf::Sample, phase::n_phases>;
 
 
 class Raptor {
 private:
     const Timetable* const m_timetable;
     bool stops_improved = false;
-    std::vector<bool> stop_is_marked;
-    std::vector<Time> prev_earliest_arrival_time;
-    std::vector<Time> earliest_arrival_time;
-    std::vector<Time> tmp_hub_labels;
+    MarkedSet marked_stops;
+    MarkedSet improved_hubs;
+    std::vector<Time> marked_stops_labels;
+    EpochArray<Time> prev_earliest_arrival_time;
+    EpochArray<Time> earliest_arrival_time;
+    EpochArray<Time> tmp_hub_labels;
+
+    // The labels of the backward queries, i.e., the latest departure times reaching the target in time
+    EpochArray<Time> latest_departure_time {Time(Time::neg_inf)};
+    EpochArray<Time> prev_latest_departure_time {Time(Time::neg_inf)};
+    EpochArray<Time> tmp_hub_departures {Time(Time::neg_inf)};
+    RoundLabels<Time> round_labels;
+    RouteQueue queue;
+
+    // The parents of the labels in each round, only recorded if the journeys are needed
+    std::vector<EpochArray<Parent>> parents;
+    EpochArray<node_id_t> hub_parents {NULL_STOP};
+    node_id_t m_source_id = NULL_STOP;
+    node_id_t m_target_id = NULL_STOP;
+    Time m_departure_time;
+    bool m_labels_by_round = false;
+    size_t m_round = 0;
+
+    // The work of the query and of the current round, only counted if the query is given its statistics
+    QueryStats* m_query_stats = nullptr;
+    RoundStats* m_round_stats = nullptr;
+
+    // The hardware counters of the thread running the queries, null if they are not recorded or unavailable
+    std::unique_ptr<perf::Counters> m_perf_counters;
+    PhaseCounts m_phase_counts;
+
+    size_t latest_trip(const Route& route, const size_t& stop_idx, const Time& t, const size_t& first_trip) const;
+
+    template<class Labels>
+    void scan_routes(Labels& labels);
+
+    void make_backward_queue();
+
+    void scan_routes_backward(const node_id_t& source_id);
+
+    void scan_footpaths_backward(const node_id_t& source_id);
 
-    bool check_stops_order(const route_id_t& route, const node_id_t& stop1, const node_id_t& stop2);
+    template<class Labels>
+    void scan_footpaths(Labels& labels);
 
-    route_stop_queue_t make_queue();
+    void reset_parents();
 
-    trip_id_t earliest_trip(const route_id_t& route_id, const size_t& stop_idx, const Time& t);
+    void set_parent(const size_t& round, const node_id_t& stop_id, const Parent& parent);
 
-    void scan_footpaths(const node_id_t& target_id);
+    void set_walk_parent(const size_t& round, const node_id_t& stop_id, const node_id_t& walked_from);
+
+    size_t parent_round(const node_id_t& stop_id, const size_t& round) const;
+
+    Time walking_time(const node_id_t& from_id, const node_id_t& to_id) const;
+
+    void run(const node_id_t& source_id, const Time& departure_time, const std::vector<node_id_t>& targets);
+
+    void collect_departures(const node_id_t& stop_id, const Time& walking_time,
+                            const Time& earliest_dep, const Time& latest_dep, std::vector<Time>& departures) const;
 
 public:
-    explicit Raptor(const Timetable* timetable_p) : m_timetable {timetable_p} {}
+    explicit Raptor(const Timetable* timetable_p) : m_timetable {timetable_p} {
+        queue.resize(m_timetable->routes.size());
+        marked_stops.resize(m_timetable->max_stop_id + 1);
+        earliest_arrival_time.resize(m_timetable->max_stop_id + 1);
+        prev_earliest_arrival_time.resize(m_timetable->max_stop_id + 1);
+        round_labels.resize(m_timetable->max_stop_id + 1);
+        latest_departure_time.resize(m_timetable->max_stop_id + 1);
+        prev_latest_departure_time.resize(m_timetable->max_stop_id + 1);
+
+        if (use_hl) {
+            improved_hubs.resize(m_timetable->n_hubs);
+            tmp_hub_labels.resize(m_timetable->n_hubs);
+            tmp_hub_departures.resize(m_timetable->n_hubs);
+
+            if (record_journeys) {
+                hub_parents.resize(m_timetable->n_hubs);
+            }
+        }
+
+        // The counters follow the thread creating the engine, which must also be the thread running the queries
+        if (record_perf) {
+            m_perf_counters.reset(new perf::Counters);
+            if (!m_perf_counters->available()) m_perf_counters.reset();
+        }
+    }
+
+    // Answer queries one after another, the labels of the previous query are reset in constant time.
+    // If stats is given, the work done in each round is appended to it.
+    std::vector<Time> query(const node_id_t& source_id, const node_id_t& target_id, const Time& departure_time,
+                            QueryStats* stats = nullptr);
+
+    // The hardware events counted in each phase of the last call to query(), all zero if they are not recorded
+    const PhaseCounts& phase_counts() const { return m_phase_counts; }
+
+    // The stages of query(), which can also be run one at a time, e.g., to measure them in isolation.
+    // After begin_query, each round runs copy_labels, make_queue and scan_round_routes, then scan_round_footpaths
+    // if scan_round_routes returns true, otherwise the query is done.
+    void begin_query(const node_id_t& source_id, const node_id_t& target_id, const Time& departure_time,
+                     QueryStats* stats = nullptr);
 
-    std::vector<Time> query(const node_id_t& source_id, const node_id_t& target_id, const Time& departure_time);
+    void copy_labels();
 
-    void init();
+    // Build the queue of routes serving the marked stops, then unmark the stops
+    const RouteQueue& make_queue();
 
-    void clear();
+    bool scan_round_routes();
+
+    void scan_round_footpaths();
+
+    // Find the earliest trip among the first n_trips trips of the route that can be caught at the stop
+    // at position stop_idx by arriving at time t
+    size_t earliest_trip(const Route& route, const size_t& stop_idx, const Time& t, const size_t& n_trips);
+
+    // Find the latest departure times from the source in each round to arrive at the target by the arrival time,
+    // by running the rounds backward from the target. A departure time is Time::neg_inf if there is no journey.
+    std::vector<Time> backward_query(const node_id_t& source_id, const node_id_t& target_id, const Time& arrival_time);
+
+    // The legs of the journey to the target found by the last query in the given round, or no leg
+    // if the target is not reached or if the journeys are not recorded. The legs are only rebuilt on demand.
+    std::vector<Leg> journey(const node_id_t& target_id, const size_t& round) const;
+
+    // Find the journeys leaving the source in [earliest_dep, latest_dep] which are Pareto-optimal
+    // with respect to the departure time, the arrival time, and the number of transfers (rRAPTOR).
+    // The journeys are sorted by departure time, journeys made only of walking are not included.
+    std::vector<Journey> range_query(const node_id_t& source_id, const node_id_t& target_id,
+                                     const Time& earliest_dep, const Time& latest_dep);
+
+    // Find the earliest arrival times at all the stops in each round, without target pruning.
+    // The labels are only valid until the next query on this engine.
+    const RoundLabels<Time>& one_to_all(const node_id_t& source_id, const Time& departure_time);
+
+    // Find the travel time from each source to each target, leaving at the departure time,
+    // the travel time is infinite if the target cannot be reached. This runs one search per source for all
+    // the targets, nothing is shared between the searches of different sources except the labels of the engine,
+    // which are reset in constant time. parallel_many_to_many runs the searches on several threads.
+    std::vector<std::vector<Time>> many_to_many(const std::vector<node_id_t>& source_ids,
+                                                const std::vector<node_id_t>& target_ids,
+                                                const Time& departure_time);
 };
 
 
+// The same travel times as Raptor::many_to_many, with the sources shared by n_threads threads (0 for all the
+// cores), each searching from its sources with its own engine
+std::vector<std::vector<Time>> parallel_many_to_many(const Timetable* timetable,
+                                                     const std::vector<node_id_t>& source_ids,
+                                                     const std::vector<node_id_t>& target_ids,
+                                                     const Time& departure_time, const size_t& n_threads);
+
+
 #endif // RAPTOR_HPP
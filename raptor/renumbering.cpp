@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <vector>
+
+#include "data_structure.hpp"
+
+
+// Renumber the stops and the routes so that the labels read one after another by the queries
+// are close in memory. The routes are visited in breadth-first order, from a route to the routes
+// sharing a stop with it, so that the routes serving the same area are consecutive.
+// The stops are numbered in the order of their first appearance along these routes,
+// hence the stops of a route mostly have close ids, and the stops without routes come last.
+// The trips keep their ids, since they are only used to describe the journeys.
+void Timetable::renumber() {
+    std::vector<node_id_t> stop_order;
+    std::vector<route_id_t> route_order;
+    stop_order.reserve(stops.size());
+    route_order.reserve(routes.size());
+
+    std::vector<bool> is_stop_visited(stops.size(), false);
+    std::vector<bool> is_route_visited(routes.size(), false);
+
+    for (const auto& root: routes) {
+        if (is_route_visited[root.id]) continue;
+
+        is_route_visited[root.id] = true;
+        route_order.push_back(root.id);
+
+        // The routes of route_order after head form the queue of the breadth-first search
+        for (size_t head = route_order.size() - 1; head < route_order.size(); ++head) {
+            for (const auto& stop_id: stops_of(routes[route_order[head]])) {
+                if (is_stop_visited[stop_id]) continue;
+
+                is_stop_visited[stop_id] = true;
+                stop_order.push_back(stop_id);
+
+                for (const auto& stop_route: routes_of(stops[stop_id])) {
+                    if (is_route_visited[stop_route.route_id]) continue;
+
+                    is_route_visited[stop_route.route_id] = true;
+                    route_order.push_back(stop_route.route_id);
+                }
+            }
+        }
+    }
+
+    for (const auto& stop: stops) {
+        if (!is_stop_visited[stop.id]) stop_order.push_back(stop.id);
+    }
+
+    std::vector<node_id_t> new_stop_ids(stops.size());
+    for (size_t i = 0; i < stop_order.size(); ++i) {
+        new_stop_ids[stop_order[i]] = static_cast<node_id_t>(i);
+    }
+
+    // The slices of the routes are laid out again in the new order of the routes
+    std::vector<Route> new_routes;
+    std::vector<node_id_t> new_route_stops;
+    std::vector<trip_id_t> new_route_trips;
+    std::vector<Time::value_type> new_trip_offsets;
+    std::vector<StopTime> new_stop_times;
+    std::vector<Time::value_type> new_departures;
+    std::vector<Time::value_type> new_arrivals;
+
+    new_routes.reserve(routes.size());
+    new_route_stops.reserve(route_stops.size());
+    new_route_trips.reserve(route_trips.size());
+    new_trip_offsets.reserve(trip_offsets.size());
+    new_stop_times.reserve(stop_times.size());
+    new_departures.reserve(departures.size());
+    new_arrivals.reserve(arrivals.size());
+
+    for (size_t i = 0; i < route_order.size(); ++i) {
+        const auto& old_route = routes[route_order[i]];
+        const size_t n_stop_times = old_route.n_stops * old_route.n_rows();
+        const size_t n_column_times = old_route.is_periodic ? 0 : old_route.n_stops * old_route.n_trips;
+
+        Route route = old_route;
+        route.id = static_cast<route_id_t>(i);
+        route.stops_idx = new_route_stops.size();
+        route.trips_idx = new_route_trips.size();
+        route.stop_times_idx = new_stop_times.size();
+        route.columns_idx = new_departures.size();
+        new_routes.push_back(route);
+
+        for (const auto& stop_id: stops_of(old_route)) {
+            new_route_stops.push_back(new_stop_ids[stop_id]);
+        }
+
+        for (const auto& trip_id: trips_of(old_route)) {
+            trip_positions[trip_id].first = route.id;
+            new_route_trips.push_back(trip_id);
+        }
+
+        for (size_t k = 0; k < route.n_trips; ++k) {
+            new_trip_offsets.push_back(trip_offset(old_route, k));
+        }
+
+        for (size_t k = 0; k < n_stop_times; ++k) {
+            new_stop_times.push_back(stop_times[old_route.stop_times_idx + k]);
+        }
+
+        for (size_t k = 0; k < n_column_times; ++k) {
+            new_departures.push_back(departures[old_route.columns_idx + k]);
+            new_arrivals.push_back(arrivals[old_route.columns_idx + k]);
+        }
+    }
+
+    routes = std::move(new_routes);
+    route_stops = std::move(new_route_stops);
+    route_trips = std::move(new_route_trips);
+    trip_offsets = std::move(new_trip_offsets);
+    stop_times = std::move(new_stop_times);
+    departures = std::move(new_departures);
+    arrivals = std::move(new_arrivals);
+
+    // The slices of the stops are laid out again in the new order of the stops
+    std::vector<Stop> new_stops;
+    std::vector<Transfer> new_transfers;
+    std::vector<Transfer> new_backward_transfers;
+    std::vector<hub_t> new_in_hubs;
+    std::vector<hub_t> new_out_hubs;
+
+    new_stops.reserve(stops.size());
+    new_transfers.reserve(transfers.size());
+    new_backward_transfers.reserve(backward_transfers.size());
+    new_in_hubs.reserve(in_hubs.size());
+    new_out_hubs.reserve(out_hubs.size());
+
+    for (size_t i = 0; i < stop_order.size(); ++i) {
+        const auto& old_stop = stops[stop_order[i]];
+
+        Stop stop = old_stop;
+        stop.id = static_cast<node_id_t>(i);
+        stop.transfers_idx = new_transfers.size();
+        stop.backward_transfers_idx = new_backward_transfers.size();
+        stop.in_hubs_idx = new_in_hubs.size();
+        stop.out_hubs_idx = new_out_hubs.size();
+        new_stops.push_back(stop);
+
+        for (const auto& transfer: transfers_of(old_stop)) {
+            new_transfers.emplace_back(new_stop_ids[transfer.dest], transfer.time.val());
+        }
+
+        // The transfers with the same walking time are sorted by destination
+        std::sort(new_transfers.begin() + stop.transfers_idx, new_transfers.end());
+
+        for (const auto& transfer: backward_transfers_of(old_stop)) {
+            new_backward_transfers.emplace_back(new_stop_ids[transfer.dest], transfer.time.val());
+        }
+
+        std::sort(new_backward_transfers.begin() + stop.backward_transfers_idx, new_backward_transfers.end());
+
+        new_in_hubs.insert(new_in_hubs.end(), in_hubs_of(old_stop).begin(), in_hubs_of(old_stop).end());
+        new_out_hubs.insert(new_out_hubs.end(), out_hubs_of(old_stop).begin(), out_hubs_of(old_stop).end());
+    }
+
+    stops = std::move(new_stops);
+    transfers = std::move(new_transfers);
+    backward_transfers = std::move(new_backward_transfers);
+    in_hubs = std::move(new_in_hubs);
+    out_hubs = std::move(new_out_hubs);
+
+    // The hubs keep their ids, only the stops of their slices are renumbered
+    auto renumber_inverse_hubs = [&](FlatArray<hub_t>& inverse_hubs, const FlatArray<size_t>& inverse_hubs_idx) {
+        for (auto& kv: inverse_hubs) {
+            kv.second = new_stop_ids[kv.second];
+        }
+
+        for (size_t hub_id = 0; hub_id + 1 < inverse_hubs_idx.size(); ++hub_id) {
+            std::sort(inverse_hubs.begin() + inverse_hubs_idx[hub_id],
+                      inverse_hubs.begin() + inverse_hubs_idx[hub_id + 1]);
+        }
+    };
+
+    renumber_inverse_hubs(inverse_in_hubs, inverse_in_hubs_idx);
+    renumber_inverse_hubs(inverse_out_hubs, inverse_out_hubs_idx);
+
+    build_stop_routes();
+
+    external_stop_ids = std::move(stop_order);
+    internal_stop_ids = std::move(new_stop_ids);
+    external_route_ids = std::move(route_order);
+}
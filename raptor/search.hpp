@@ -0,0 +1,58 @@
+#ifndef SEARCH_HPP
+#define SEARCH_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef USE_AVX2
+#include <immintrin.h>
+#endif
+
+
+// The search of the first value at or after t in a sorted column of times, e.g., the departure times
+// of the trips of a route at a stop. A long column is narrowed down by a branchless binary search,
+// so that the comparisons do not cause branch mispredictions, and the remaining short range is scanned
+// linearly, 8 values at a time with AVX2 if enabled with the USE_AVX2 option of CMake.
+namespace search {
+    // The columns up to this size are scanned linearly
+    const std::size_t linear_scan_size = 32;
+
+    // The number of values smaller than t among the n values
+    inline std::size_t count_less(const int32_t* values, const std::size_t& n, const int32_t& t) {
+        std::size_t count = 0;
+        std::size_t i = 0;
+
+#ifdef USE_AVX2
+        const __m256i t_vec = _mm256_set1_epi32(t);
+
+        for (; i + 8 <= n; i += 8) {
+            const __m256i values_vec = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+            const __m256i less = _mm256_cmpgt_epi32(t_vec, values_vec);
+
+            count += static_cast<std::size_t>(__builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(less))));
+        }
+#endif
+
+        for (; i < n; ++i) {
+            count += values[i] < t;
+        }
+
+        return count;
+    }
+
+    // The position of the first value at or after t among the n sorted values, or n if there is none
+    inline std::size_t first_at_or_after(const int32_t* values, std::size_t n, const int32_t& t) {
+        const int32_t* base = values;
+
+        // The values before base are smaller than t, and the position lies in [base, base + n]
+        while (n > linear_scan_size) {
+            const std::size_t half = n / 2;
+            base = base[half] < t ? base + half : base;
+            n -= half;
+        }
+
+        return static_cast<std::size_t>(base - values) + count_less(base, n, t);
+    }
+}
+
+#endif // SEARCH_HPP
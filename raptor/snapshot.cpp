@@ -0,0 +1,365 @@
+#include <algorithm>
+#include <cstdio> // std::rename
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "data_structure.hpp"
+#include "snapshot.hpp"
+
+
+uint32_t snapshot::checksum(const void* data, std::size_t n_bytes) {
+    auto bytes = static_cast<const Bytef*>(data);
+    uLong crc = crc32(0L, Z_NULL, 0);
+
+    // crc32 takes the length as a 32-bit integer, so large sections are processed by chunks
+    while (n_bytes > 0) {
+        auto chunk = static_cast<uInt>(std::min<std::size_t>(n_bytes, 1u << 30));
+        crc = crc32(crc, bytes, chunk);
+        bytes += chunk;
+        n_bytes -= chunk;
+    }
+
+    return static_cast<uint32_t>(crc);
+}
+
+
+MappedFile::MappedFile(const std::string& file_path) {
+    int fd = open(file_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open the snapshot " + file_path);
+    }
+
+    struct stat file_stat {};
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+        close(fd);
+        throw std::runtime_error("Cannot read the snapshot " + file_path);
+    }
+
+    m_size = static_cast<std::size_t>(file_stat.st_size);
+    void* addr = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    // The mapping stays valid after the file descriptor is closed
+    close(fd);
+
+    if (addr == MAP_FAILED) {
+        throw std::runtime_error("Cannot map the snapshot " + file_path);
+    }
+
+    m_data = static_cast<const char*>(addr);
+}
+
+
+MappedFile::~MappedFile() {
+    munmap(const_cast<char*>(m_data), m_size);
+}
+
+
+namespace {
+    std::size_t align(const std::size_t& offset) {
+        return (offset + snapshot::alignment - 1) / snapshot::alignment * snapshot::alignment;
+    }
+
+    uint32_t header_checksum(const snapshot::Header& header) {
+        return snapshot::checksum(&header, offsetof(snapshot::Header, header_checksum));
+    }
+
+    // Collect the position of each flat array in the snapshot
+    class SectionWriter {
+    public:
+        std::vector<snapshot::Section> sections;
+        std::vector<const char*> data;
+        std::size_t offset;
+
+        explicit SectionWriter(const std::size_t& n_sections) :
+                offset {sizeof(snapshot::Header) + n_sections * sizeof(snapshot::Section)} {}
+
+        template<class T>
+        void operator()(const char* name, const FlatArray<T>& array) {
+            snapshot::Section section {};
+            std::strncpy(section.name, name, sizeof(section.name) - 1);
+
+            offset = align(offset);
+            section.offset = offset;
+            section.size = array.size();
+            section.element_size = sizeof(T);
+            section.checksum = snapshot::checksum(array.data(), array.size() * sizeof(T));
+
+            offset += array.size() * sizeof(T);
+
+            sections.push_back(section);
+            data.push_back(reinterpret_cast<const char*>(array.data()));
+        }
+    };
+
+    class SectionCounter {
+    public:
+        std::size_t n_sections = 0;
+
+        template<class T>
+        void operator()(const char*, const FlatArray<T>&) { ++n_sections; }
+    };
+
+    // Point each flat array to its section in the mapped file, after validating the section
+    class SectionLoader {
+    private:
+        const MappedFile& m_file;
+        const snapshot::Section* m_sections;
+        std::size_t m_n_sections;
+        std::size_t m_idx = 0;
+
+        [[noreturn]] void fail(const std::string& name, const std::string& reason) const {
+            throw std::runtime_error("Invalid section " + name + " in the snapshot: " + reason);
+        }
+
+    public:
+        SectionLoader(const MappedFile& file, const snapshot::Section* sections, const std::size_t& n_sections) :
+                m_file {file}, m_sections {sections}, m_n_sections {n_sections} {}
+
+        template<class T>
+        void operator()(const char* name, FlatArray<T>& array) {
+            if (m_idx >= m_n_sections) fail(name, "missing");
+
+            const auto& section = m_sections[m_idx++];
+
+            if (std::strncmp(section.name, name, sizeof(section.name)) != 0) {
+                fail(name, "found " + std::string(section.name, strnlen(section.name, sizeof(section.name))));
+            }
+
+            if (section.element_size != sizeof(T)) fail(name, "wrong element size");
+
+            if (section.offset % snapshot::alignment != 0) fail(name, "misaligned");
+
+            if (section.offset > m_file.size() || section.size > (m_file.size() - section.offset) / sizeof(T)) {
+                fail(name, "out of the file");
+            }
+
+            const char* data = m_file.data() + section.offset;
+
+            if (verify_snapshot && snapshot::checksum(data, section.size * sizeof(T)) != section.checksum) {
+                fail(name, "checksum mismatch");
+            }
+
+            array.map(reinterpret_cast<const T*>(data), section.size);
+        }
+    };
+}
+
+
+std::string Timetable::snapshot_path() const {
+    return path + (use_hl ? "timetable_hl.bin" : "timetable.bin");
+}
+
+
+void Timetable::write_snapshot(const std::string& file_path) const {
+    SectionCounter counter;
+    for_each_array(*this, counter);
+
+    SectionWriter writer {counter.n_sections};
+    for_each_array(*this, writer);
+
+    snapshot::Header header {};
+    std::memcpy(header.magic, snapshot::magic, sizeof(header.magic));
+    header.version = snapshot::version;
+    header.byte_order_mark = snapshot::byte_order_mark;
+    header.use_hl = use_hl;
+    header.n_sections = static_cast<uint32_t>(writer.sections.size());
+    header.file_size = writer.offset;
+    header.max_stop_id = max_stop_id;
+    header.max_node_id = max_node_id;
+    header.sections_checksum = snapshot::checksum(writer.sections.data(),
+                                                  writer.sections.size() * sizeof(snapshot::Section));
+    header.header_checksum = header_checksum(header);
+
+    // Write to a temporary file first, so that processes mapping the current snapshot are not affected
+    const std::string tmp_path = file_path + ".tmp";
+    std::ofstream file {tmp_path, std::ios::binary};
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(writer.sections.data()),
+               writer.sections.size() * sizeof(snapshot::Section));
+
+    const std::vector<char> padding(snapshot::alignment, 0);
+    for (size_t i = 0; i < writer.sections.size(); ++i) {
+        const auto& section = writer.sections[i];
+
+        file.write(padding.data(), static_cast<std::streamsize>(section.offset) - file.tellp());
+        file.write(writer.data[i], static_cast<std::streamsize>(section.size * section.element_size));
+    }
+
+    file.close();
+    if (!file || std::rename(tmp_path.c_str(), file_path.c_str()) != 0) {
+        throw std::runtime_error("Cannot write the snapshot " + file_path);
+    }
+}
+
+
+void Timetable::load_snapshot(const std::string& file_path) {
+    Timer timer;
+
+    std::cout << "Loading the snapshot " << file_path << "..." << std::endl;
+
+    std::shared_ptr<const MappedFile> file {new MappedFile {file_path}};
+
+    if (file->size() < sizeof(snapshot::Header)) {
+        throw std::runtime_error("The snapshot is truncated");
+    }
+
+    snapshot::Header header {};
+    std::memcpy(&header, file->data(), sizeof(header));
+
+    if (std::memcmp(header.magic, snapshot::magic, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("The file is not a timetable snapshot");
+    }
+
+    if (header.byte_order_mark != snapshot::byte_order_mark) {
+        throw std::runtime_error("The snapshot was built on a machine with another byte order");
+    }
+
+    if (header.version != snapshot::version) {
+        throw std::runtime_error("The snapshot has version " + std::to_string(header.version) +
+                                 ", expected version " + std::to_string(snapshot::version));
+    }
+
+    if (header.header_checksum != header_checksum(header)) {
+        throw std::runtime_error("The header of the snapshot is corrupted");
+    }
+
+    if (header.file_size != file->size()) {
+        throw std::runtime_error("The snapshot is truncated");
+    }
+
+    if (static_cast<bool>(header.use_hl) != use_hl) {
+        throw std::runtime_error(use_hl ? "The snapshot was built without hub labelling"
+                                        : "The snapshot was built with hub labelling");
+    }
+
+    const auto* sections = reinterpret_cast<const snapshot::Section*>(file->data() + sizeof(header));
+    const auto sections_size = header.n_sections * sizeof(snapshot::Section);
+
+    if (sections_size > file->size() - sizeof(header) ||
+        snapshot::checksum(sections, sections_size) != header.sections_checksum) {
+        throw std::runtime_error("The section table of the snapshot is corrupted");
+    }
+
+    SectionLoader loader {*file, sections, header.n_sections};
+    for_each_array(*this, loader);
+
+    max_stop_id = header.max_stop_id;
+    max_node_id = header.max_node_id;
+    n_hubs = inverse_in_hubs_idx.empty() ? 0 : inverse_in_hubs_idx.size() - 1;
+    m_snapshot = file;
+
+    check_layout();
+
+    std::cout << "Complete loading the snapshot." << std::endl;
+    std::cout << "Time elapsed: " << timer.elapsed() << timer.unit() << std::endl;
+}
+
+
+// Check that the slices of the routes and stops lie within the flat arrays, and that every id or position
+// read from an array and then used as an index by the queries is in range, so that a snapshot whose sections
+// are consistent but whose content is wrong cannot make the queries read out of bounds. The times themselves
+// are not checked, a corrupted time is only detected by the checksums with --verify.
+void Timetable::check_layout() const {
+    auto check = [](bool condition, const std::string& what) {
+        if (!condition) throw std::runtime_error("Inconsistent timetable layout: " + what);
+    };
+
+    // Whether the slice [idx, idx + n) lies within an array of the given size, written so that idx + n,
+    // which can wrap around with a corrupted snapshot, is never computed
+    auto fits = [](const size_t& idx, const size_t& n, const size_t& size) {
+        return n <= size && idx <= size - n;
+    };
+
+    // Same for a table of n_rows x n_columns elements
+    auto fits_table = [](const size_t& idx, const size_t& n_rows, const size_t& n_columns, const size_t& size) {
+        return idx <= size && (n_rows == 0 || n_columns <= (size - idx) / n_rows);
+    };
+
+    check(stops.size() == max_stop_id + 1, "stops");
+
+    for (const auto& route: routes) {
+        check(fits(route.stops_idx, route.n_stops, route_stops.size()), "route stops");
+        check(fits(route.trips_idx, route.n_trips, route_trips.size()), "route trips");
+        check(fits_table(route.stop_times_idx, route.n_rows(), route.n_stops, stop_times.size()), "stop times");
+
+        if (!route.is_periodic) {
+            check(fits_table(route.columns_idx, route.n_trips, route.n_stops, departures.size()), "departures");
+        }
+    }
+
+    check(arrivals.size() == departures.size(), "arrivals");
+    check(trip_offsets.size() == route_trips.size(), "trip offsets");
+
+    // The journeys go from the trips of the routes to their positions, and back to the routes
+    for (size_t route_idx = 0; route_idx < routes.size(); ++route_idx) {
+        const auto& route = routes[route_idx];
+
+        for (size_t pos = 0; pos < route.n_trips; ++pos) {
+            const auto& trip_id = route_trips[route.trips_idx + pos];
+
+            check(trip_id >= 0 && static_cast<size_t>(trip_id) < trip_positions.size(), "trip id");
+            check(trip_positions[trip_id].first == route_idx && trip_positions[trip_id].second == pos,
+                  "trip position");
+        }
+    }
+
+    for (const auto& stop: stops) {
+        check(fits(stop.routes_idx, stop.n_routes, stop_routes.size()), "stop routes");
+        check(fits(stop.transfers_idx, stop.n_transfers, transfers.size()), "transfers");
+        check(fits(stop.backward_transfers_idx, stop.n_backward_transfers, backward_transfers.size()),
+              "backward transfers");
+        check(fits(stop.in_hubs_idx, stop.n_in_hubs, in_hubs.size()), "in-hubs");
+        check(fits(stop.out_hubs_idx, stop.n_out_hubs, out_hubs.size()), "out-hubs");
+    }
+
+    for (const auto& stop_id: route_stops) {
+        check(stop_id < stops.size(), "stop id");
+    }
+
+    for (const auto& stop_route: stop_routes) {
+        check(stop_route.route_id < routes.size(), "route id");
+        check(stop_route.stop_idx < routes[stop_route.route_id].n_stops, "stop position");
+    }
+
+    for (const auto& transfer: transfers) {
+        check(transfer.dest < stops.size(), "transfer destination");
+    }
+
+    for (const auto& transfer: backward_transfers) {
+        check(transfer.dest < stops.size(), "backward transfer destination");
+    }
+
+    // The ids of the stops and the routes in the dataset are permutations of their ids in the timetable
+    check(external_stop_ids.size() == stops.size() && internal_stop_ids.size() == stops.size(), "stop ids");
+    for (size_t i = 0; i < external_stop_ids.size(); ++i) {
+        check(external_stop_ids[i] < stops.size() && internal_stop_ids[external_stop_ids[i]] == i, "stop ids");
+    }
+
+    check(external_route_ids.size() == routes.size(), "route ids");
+    for (const auto& route_id: external_route_ids) {
+        check(route_id < routes.size(), "route ids");
+    }
+
+    if (use_hl) {
+        check(inverse_in_hubs_idx.size() == n_hubs + 1, "inverse in-hubs");
+        check(inverse_out_hubs_idx.size() == n_hubs + 1, "inverse out-hubs");
+        check(inverse_in_hubs_idx.back() == inverse_in_hubs.size(), "inverse in-hubs");
+        check(inverse_out_hubs_idx.back() == inverse_out_hubs.size(), "inverse out-hubs");
+        check(std::is_sorted(inverse_in_hubs_idx.begin(), inverse_in_hubs_idx.end()), "inverse in-hubs");
+        check(std::is_sorted(inverse_out_hubs_idx.begin(), inverse_out_hubs_idx.end()), "inverse out-hubs");
+
+        // The hubs index the labels of the hubs in the queries
+        for (const auto& kv: in_hubs) check(kv.second < n_hubs, "hub id");
+        for (const auto& kv: out_hubs) check(kv.second < n_hubs, "hub id");
+        for (const auto& kv: inverse_in_hubs) check(kv.second < stops.size(), "stop id");
+        for (const auto& kv: inverse_out_hubs) check(kv.second < stops.size(), "stop id");
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+// The binary snapshot of a timetable consists of a header, a table describing each section,
+// and the sections themselves. Each section is the raw content of one flat array of the timetable,
+// aligned on a cache line, so that the arrays can point directly into the mapped file.
+namespace snapshot {
+    // Increase the version whenever the layout of the timetable changes
+    const uint32_t version = 9;
+
+    const char magic[8] = {'R', 'A', 'P', 'T', 'O', 'R', 'T', 'T'};
+
+    // Written in the native byte order, used to detect a snapshot built on another architecture
+    const uint32_t byte_order_mark = 0x01020304;
+
+    const std::size_t alignment = 64;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order_mark;
+        uint32_t use_hl;
+        uint32_t n_sections;
+        uint64_t file_size;
+        uint64_t max_stop_id;
+        uint64_t max_node_id;
+        uint32_t sections_checksum;  // Checksum of the section table
+        uint32_t header_checksum;  // Checksum of all the previous fields
+    };
+
+    struct Section {
+        char name[32];
+        uint64_t offset;
+        uint64_t size;  // Number of elements
+        uint32_t element_size;
+        uint32_t checksum;  // Checksum of the data
+    };
+
+    uint32_t checksum(const void* data, std::size_t n_bytes);
+}
+
+
+// A read-only shared memory mapping of a whole file, the pages are shared
+// with all the other processes mapping the same file
+class MappedFile {
+private:
+    const char* m_data = nullptr;
+    std::size_t m_size = 0;
+
+public:
+    explicit MappedFile(const std::string& file_path);
+
+    MappedFile(const MappedFile&) = delete;
+
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile();
+
+    const char* data() const { return m_data; }
+
+    std::size_t size() const { return m_size; }
+};
+
+#endif // SNAPSHOT_HPP
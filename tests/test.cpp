@@ -1,4 +1,6 @@
 #define CATCH_CONFIG_RUNNER
+// The bundled Catch sizes its signal stack with SIGSTKSZ, which is no longer a constant in recent glibc
+#define CATCH_CONFIG_NO_POSIX_SIGNALS
 
 #include <string>
 
@@ -10,6 +12,15 @@ std::string name;
 bool use_hl;
 bool profile;
 bool ranked;
+bool use_snapshot;
+bool verify_snapshot;
+std::size_t n_threads = 1;
+int range_window = 0;
+bool record_journeys;
+bool multi_criteria;
+bool arrive_by;
+bool record_stats;
+bool record_perf;
 
 
 int main(int argc, char* argv[]) {
@@ -1,19 +1,63 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
 #include "catch.hpp"
 #include "data_structure.hpp"
+#include "snapshot.hpp"
 
 
-// The rows in each stop_times_by_trips have the same size, which is the size of the stop pattern,
-// and the number of rows equals the number of trips
+// The slices of the routes in the flat arrays are consecutive and cover the whole arrays,
+// the stop events table of each route has one row per stored trip and one column per stop in the pattern
 bool test_stop_times_sizes(const Timetable& timetable) {
-    for (const auto& route: timetable.routes) {
-        const auto& n_route_stops = route.stops.size();
+    size_t n_route_stops = 0;
+    size_t n_trips = 0;
+    size_t n_stop_times = 0;
+    size_t n_column_times = 0;
 
-        if (route.stop_times_by_trips.size() != route.trips.size()) {
+    for (const auto& route: timetable.routes) {
+        if (route.stops_idx != n_route_stops || route.trips_idx != n_trips ||
+            route.stop_times_idx != n_stop_times || route.columns_idx != n_column_times) {
             return false;
         }
 
-        for (const auto& row: route.stop_times_by_trips) {
-            if (row.size() != n_route_stops) return false;
+        n_route_stops += route.n_stops;
+        n_trips += route.n_trips;
+        n_stop_times += route.n_stops * route.n_rows();
+        n_column_times += route.is_periodic ? 0 : route.n_stops * route.n_trips;
+    }
+
+    return n_route_stops == timetable.route_stops.size() &&
+           n_trips == timetable.route_trips.size() &&
+           n_trips == timetable.trip_offsets.size() &&
+           n_stop_times == timetable.stop_times.size() &&
+           n_column_times == timetable.departures.size() &&
+           n_column_times == timetable.arrivals.size();
+}
+
+
+// The columns of departure and arrival times of each route give the stop events of its trips
+bool test_stop_major_columns(const Timetable& timetable) {
+    for (const auto& route: timetable.routes) {
+        for (size_t j = 0; j < route.n_stops; ++j) {
+            const auto& departures = timetable.departures_of_stop(route, j);
+            const auto& arrivals = timetable.arrivals_of_stop(route, j);
+
+            for (size_t i = 0; i < route.n_trips; ++i) {
+                const auto& st = timetable.stop_time(route, i, j);
+
+                if (departures.values[i] + departures.shift != st.dep.val() ||
+                    arrivals.values[i] + arrivals.shift != st.arr.val()) {
+                    return false;
+                }
+            }
         }
     }
 
@@ -21,19 +65,15 @@ bool test_stop_times_sizes(const Timetable& timetable) {
 }
 
 
-// The rows in each stop_times_by_stops have the same size, which is the number of trips,
-// and the number of rows equals the number of unique stops in the stop pattern
-bool test_stop_times_by_stops_sizes(const Timetable& timetable) {
+// Only the periodic routes, which have several trips, have trip offsets, which begin at zero
+bool test_trip_offsets(const Timetable& timetable) {
     for (const auto& route: timetable.routes) {
-        const auto& n_stops = route.stops.size();
-        const auto& n_trips = route.trips.size();
+        if (route.is_periodic && route.n_trips < 2) return false;
 
-        if (route.stop_times_by_stops.size() != n_stops) {
-            return false;
-        }
+        for (size_t i = 0; i < route.n_trips; ++i) {
+            const auto& offset = timetable.trip_offset(route, i);
 
-        for (const auto& row: route.stop_times_by_stops) {
-            if (row.size() != n_trips) return false;
+            if (route.is_periodic ? (i == 0 && offset != 0) : offset != 0) return false;
         }
     }
 
@@ -41,12 +81,12 @@ bool test_stop_times_by_stops_sizes(const Timetable& timetable) {
 }
 
 
-// The rows in each stop_times_by_trips table are ordered
+// The rows in each stop_times table are ordered
 bool test_stop_times_rows_ordered(const Timetable& timetable) {
     for (const auto& route: timetable.routes) {
-        for (size_t j = 0; j < route.stops.size() - 1; ++j) {
-            for (size_t i = 0; i < route.trips.size(); ++i) {
-                if (route.stop_times_by_trips[i][j].arr > route.stop_times_by_trips[i][j + 1].arr) {
+        for (size_t i = 0; i < route.n_trips; ++i) {
+            for (size_t j = 0; j + 1 < route.n_stops; ++j) {
+                if (timetable.stop_time(route, i, j).arr > timetable.stop_time(route, i, j + 1).arr) {
                     return false;
                 }
             }
@@ -57,12 +97,12 @@ bool test_stop_times_rows_ordered(const Timetable& timetable) {
 }
 
 
-// The columns in each stop_times_by_trips table are ordered
+// The columns in each stop_times table are ordered
 bool test_stop_times_columns_ordered(const Timetable& timetable) {
     for (const auto& route: timetable.routes) {
-        for (size_t i = 0; i < route.trips.size() - 1; ++i) {
-            for (size_t j = 0; j < route.stops.size(); ++j) {
-                if (route.stop_times_by_trips[i][j].arr > route.stop_times_by_trips[i + 1][j].arr) {
+        for (size_t i = 0; i + 1 < route.n_trips; ++i) {
+            for (size_t j = 0; j < route.n_stops; ++j) {
+                if (timetable.stop_time(route, i, j).arr > timetable.stop_time(route, i + 1, j).arr) {
                     return false;
                 }
             }
@@ -73,21 +113,49 @@ bool test_stop_times_columns_ordered(const Timetable& timetable) {
 }
 
 
-// The trips of a route have the same stop pattern
-bool test_unique_pattern(const Timetable& timetable) {
-    for (const auto& route: timetable.routes) {
-        auto stops = route.stops;
+// Each stop is served by the routes visiting it, once per visit and at the right position
+bool test_stop_routes(const Timetable& timetable) {
+    size_t n_visits = 0;
 
-        for (const auto& row: route.stop_times_by_trips) {
-            // The stop pattern of this row (trip)
-            std::vector<node_id_t> row_stops;
-            for (const auto& st: row) {
-                row_stops.push_back(st.stop_id);
-            }
+    for (const auto& stop: timetable.stops) {
+        for (const auto& stop_route: timetable.routes_of(stop)) {
+            const auto& route = timetable.routes[stop_route.route_id];
+            const auto& route_stops = timetable.stops_of(route);
 
-            if (stops != row_stops) {
-                return false;
-            }
+            if (route_stops[stop_route.stop_idx] != stop.id) return false;
+
+            ++n_visits;
+        }
+    }
+
+    return n_visits == timetable.route_stops.size();
+}
+
+
+// The ids of the stops and the routes in the dataset are given by permutations of their new ids
+bool test_external_ids(const Timetable& timetable) {
+    if (timetable.external_stop_ids.size() != timetable.stops.size() ||
+        timetable.internal_stop_ids.size() != timetable.stops.size() ||
+        timetable.external_route_ids.size() != timetable.routes.size()) {
+        return false;
+    }
+
+    for (const auto& stop: timetable.stops) {
+        if (timetable.internal_stop_ids[timetable.external_stop_ids[stop.id]] != stop.id) return false;
+    }
+
+    std::vector<route_id_t> route_ids {timetable.external_route_ids.begin(), timetable.external_route_ids.end()};
+    std::sort(route_ids.begin(), route_ids.end());
+    for (size_t i = 0; i < route_ids.size(); ++i) {
+        if (route_ids[i] != i) return false;
+    }
+
+    // The trips are in the routes given by their positions
+    for (const auto& route: timetable.routes) {
+        for (size_t pos = 0; pos < route.n_trips; ++pos) {
+            const auto& trip_position = timetable.trip_positions[timetable.trips_of(route)[pos]];
+
+            if (trip_position.first != route.id || trip_position.second != pos) return false;
         }
     }
 
@@ -101,11 +169,146 @@ TEST_CASE("Test the sanity of the dataset and parser", "") {
 
     REQUIRE(test_stop_times_sizes(timetable));
 
-    REQUIRE(test_stop_times_by_stops_sizes(timetable));
+    REQUIRE(test_stop_major_columns(timetable));
+
+    REQUIRE(test_trip_offsets(timetable));
 
     REQUIRE(test_stop_times_rows_ordered(timetable));
 
     REQUIRE(test_stop_times_columns_ordered(timetable));
 
-    REQUIRE(test_unique_pattern(timetable));
+    REQUIRE(test_stop_routes(timetable));
+
+    REQUIRE(test_external_ids(timetable));
+}
+
+
+// Collect the raw bytes of each flat array of a timetable
+class ArraysCollector {
+public:
+    std::vector<std::string> arrays;
+
+    template<class T>
+    void operator()(const char*, const FlatArray<T>& array) {
+        arrays.emplace_back(reinterpret_cast<const char*>(array.data()), array.size() * sizeof(T));
+    }
+};
+
+
+TEST_CASE("Test the binary snapshot of the timetable", "") {
+    Timetable timetable {};
+    const std::string snapshot_path = "test_timetable.bin";
+    timetable.write_snapshot(snapshot_path);
+
+    verify_snapshot = true;
+    Timetable loaded = timetable;
+    loaded.load_snapshot(snapshot_path);
+    verify_snapshot = false;
+
+    REQUIRE(!loaded.stop_times.is_owning());
+
+    ArraysCollector original_arrays, loaded_arrays;
+    Timetable::for_each_array(timetable, original_arrays);
+    Timetable::for_each_array(loaded, loaded_arrays);
+    REQUIRE(original_arrays.arrays == loaded_arrays.arrays);
+
+    REQUIRE(test_stop_times_sizes(loaded));
+
+    REQUIRE(test_stop_major_columns(loaded));
+
+    std::remove(snapshot_path.c_str());
+}
+
+
+std::string read_file(const std::string& file_path) {
+    std::ifstream file {file_path, std::ios::binary};
+    return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+
+void write_file(const std::string& file_path, const std::string& content) {
+    std::ofstream file {file_path, std::ios::binary};
+    file.write(content.data(), static_cast<std::streamsize>(content.size()));
+}
+
+
+// The offset in the snapshot of the first byte of the section with the given name
+std::size_t section_offset(const std::string& content, const std::string& name) {
+    snapshot::Header header {};
+    std::memcpy(&header, content.data(), sizeof(header));
+
+    for (std::size_t i = 0; i < header.n_sections; ++i) {
+        snapshot::Section section {};
+        std::memcpy(&section, content.data() + sizeof(header) + i * sizeof(section), sizeof(section));
+
+        if (name == section.name) return section.offset;
+    }
+
+    return content.size();
+}
+
+
+TEST_CASE("Test the rejection of invalid snapshots", "") {
+    Timetable timetable {};
+    const std::string snapshot_path = "test_timetable.bin";
+    const std::string invalid_path = "test_invalid_timetable.bin";
+    timetable.write_snapshot(snapshot_path);
+
+    const auto content = read_file(snapshot_path);
+
+    SECTION("Wrong version") {
+        auto invalid = content;
+        const uint32_t version = snapshot::version + 1;
+        std::memcpy(&invalid[offsetof(snapshot::Header, version)], &version, sizeof(version));
+        write_file(invalid_path, invalid);
+
+        Timetable loaded = timetable;
+        REQUIRE_THROWS_AS(loaded.load_snapshot(invalid_path), std::runtime_error);
+    }
+
+    SECTION("Truncated file") {
+        write_file(invalid_path, content.substr(0, content.size() - snapshot::alignment));
+
+        Timetable loaded = timetable;
+        REQUIRE_THROWS_AS(loaded.load_snapshot(invalid_path), std::runtime_error);
+    }
+
+    SECTION("Flipped byte in a section") {
+        const auto offset = section_offset(content, "stop_times");
+        REQUIRE(offset < content.size());
+
+        auto invalid = content;
+        invalid[offset] = static_cast<char>(~invalid[offset]);
+        write_file(invalid_path, invalid);
+
+        verify_snapshot = true;
+        Timetable loaded = timetable;
+        REQUIRE_THROWS_AS(loaded.load_snapshot(invalid_path), std::runtime_error);
+        verify_snapshot = false;
+    }
+
+    // The checksums are valid, but the destination of a transfer is not a stop
+    SECTION("Transfer to an unknown stop") {
+        REQUIRE(!timetable.transfers.empty());
+
+        Timetable invalid = timetable;
+        invalid.transfers[0].dest = static_cast<node_id_t>(invalid.stops.size());
+        invalid.write_snapshot(invalid_path);
+
+        Timetable loaded = timetable;
+        REQUIRE_THROWS_AS(loaded.load_snapshot(invalid_path), std::runtime_error);
+    }
+
+    // The end of the slice of the route wraps around and looks within the array
+    SECTION("Overflowing slice of a route") {
+        Timetable invalid = timetable;
+        invalid.routes[0].stops_idx = std::numeric_limits<size_t>::max() - invalid.routes[0].n_stops + 2;
+        invalid.write_snapshot(invalid_path);
+
+        Timetable loaded = timetable;
+        REQUIRE_THROWS_WITH(loaded.load_snapshot(invalid_path), Catch::Contains("route stops"));
+    }
+
+    std::remove(snapshot_path.c_str());
+    std::remove(invalid_path.c_str());
 }
@@ -0,0 +1,43 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "catch.hpp"
+#include "histogram.hpp"
+
+
+// The percentiles of the histogram are those of the sorted values, up to the relative error of the buckets,
+// and merging the histograms of two halves of the values gives the histogram of all the values
+TEST_CASE("Test the percentiles of the histograms", "") {
+    std::mt19937_64 generator {42};
+    std::lognormal_distribution<double> dist(10, 3);
+
+    std::vector<uint64_t> values;
+    Histogram first_half;
+    Histogram second_half;
+    Histogram all;
+
+    for (size_t i = 0; i < 100000; ++i) {
+        values.push_back(static_cast<uint64_t>(dist(generator)));
+        (i % 2 == 0 ? first_half : second_half).record(values.back());
+        all.record(values.back());
+    }
+
+    first_half.merge(second_half);
+    std::sort(values.begin(), values.end());
+
+    REQUIRE(all.count() == values.size());
+    REQUIRE(all.min() == values.front());
+    REQUIRE(all.max() == values.back());
+
+    for (const auto& percent: {0.1, 1.0, 25.0, 50.0, 90.0, 99.0, 99.9, 100.0}) {
+        const auto rank = static_cast<size_t>(std::ceil(percent / 100 * static_cast<double>(values.size())));
+        const auto expected = values[std::max<size_t>(1, rank) - 1];
+        const auto value = all.percentile(percent);
+
+        REQUIRE(value >= expected);
+        REQUIRE(static_cast<double>(value - expected) <= static_cast<double>(expected) / 64);
+        REQUIRE(first_half.percentile(percent) == value);
+    }
+}
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "catch.hpp"
+#include "data_structure.hpp"
+#include "mc_raptor.hpp"
+#include "raptor.hpp"
+
+
+// A bag keeps exactly the labels that are not dominated by another label merged into it,
+// sorted by arrival time
+TEST_CASE("Test the merge of the labels into the bags", "") {
+    std::mt19937 generator {42};
+    std::uniform_int_distribution<Time::value_type> dist(0, 50);
+
+    BagPool bags;
+    bags.resize(3);
+
+    for (size_t n = 1; n < 200; n += 7) {
+        bags.reset();
+
+        std::vector<McLabel> labels;
+        for (size_t i = 0; i < n; ++i) {
+            labels.push_back({dist(generator), dist(generator)});
+            bags.merge(i % 3, labels.back());
+        }
+
+        for (size_t b = 0; b < 3; ++b) {
+            std::vector<McLabel> expected;
+            for (size_t i = b; i < n; i += 3) {
+                bool is_dominated = false;
+                for (size_t j = b; j < n; j += 3) {
+                    const bool is_better = labels[j].dominates(labels[i]) &&
+                                           (!labels[i].dominates(labels[j]) || j < i);
+                    is_dominated = is_dominated || is_better;
+                }
+
+                if (!is_dominated) expected.push_back(labels[i]);
+            }
+
+            std::sort(expected.begin(), expected.end(),
+                      [](const McLabel& l1, const McLabel& l2) { return l1.arr < l2.arr; });
+
+            const auto& bag = bags.bag(b);
+            REQUIRE(bag.size() == expected.size());
+
+            for (size_t i = 0; i < bag.size(); ++i) {
+                REQUIRE(bag[i].arr == expected[i].arr);
+                REQUIRE(bag[i].walking_time == expected[i].walking_time);
+            }
+        }
+    }
+}
+
+
+// The journeys of the multi-criteria query are Pareto-optimal, and the earliest arrival time
+// with at most k trips is the label of RAPTOR in round k. As for RAPTOR, this only holds if the transfers
+// are transitively closed, otherwise the journeys with more walking can reach stops that RAPTOR misses.
+bool test_mc_query(McRaptor& mc_raptor, Raptor& raptor, const node_id_t& source_id, const node_id_t& target_id,
+                   const Time& departure_time) {
+    const auto journeys = mc_raptor.query(source_id, target_id, departure_time);
+
+    for (const auto& j1: journeys) {
+        for (const auto& j2: journeys) {
+            if (&j1 == &j2) continue;
+
+            if (j2.arr <= j1.arr && j2.n_transfers <= j1.n_transfers && j2.walking_time <= j1.walking_time &&
+                !(j1.arr == j2.arr && j1.walking_time == j2.walking_time)) {
+                return false;
+            }
+        }
+    }
+
+    const auto& labels = raptor.one_to_all(source_id, departure_time);
+
+    for (size_t round = 1; round < labels.n_rounds(); ++round) {
+        Time arrival_time {};
+
+        for (const auto& journey: journeys) {
+            if (journey.n_transfers < round) arrival_time = std::min(arrival_time, journey.arr);
+        }
+
+        if (!(arrival_time == labels(round, target_id))) return false;
+    }
+
+    return true;
+}
+
+
+TEST_CASE("Test the multi-criteria query against earliest arrival queries", "") {
+    Timetable timetable {};
+    Raptor raptor {&timetable};
+    McRaptor mc_raptor {&timetable};
+
+    std::vector<node_id_t> stop_ids;
+    for (const auto& stop: timetable.stops) {
+        if (stop.is_valid()) stop_ids.push_back(stop.id);
+    }
+
+    const size_t step = std::max<size_t>(1, stop_ids.size() / 10);
+
+    for (size_t i = 0; i < stop_ids.size(); i += step) {
+        for (size_t j = step / 2; j < stop_ids.size(); j += step) {
+            if (stop_ids[i] == stop_ids[j]) continue;
+
+            REQUIRE(test_mc_query(mc_raptor, raptor, stop_ids[i], stop_ids[j], Time(8 * 3600)));
+        }
+    }
+}
@@ -0,0 +1,407 @@
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "catch.hpp"
+#include "data_structure.hpp"
+#include "raptor.hpp"
+#include "search.hpp"
+
+
+// The search of the first departure at or after a time agrees with std::lower_bound,
+// on short and long columns with repeated values
+TEST_CASE("Test the search of the departures", "") {
+    std::mt19937 generator {42};
+
+    for (size_t n = 0; n < 300; ++n) {
+        std::uniform_int_distribution<int32_t> dist(0, static_cast<int32_t>(n / 2 + 1));
+
+        std::vector<int32_t> departures(n);
+        for (auto& departure: departures) {
+            departure = dist(generator);
+        }
+        std::sort(departures.begin(), departures.end());
+
+        for (int32_t t = -1; t <= static_cast<int32_t>(n / 2 + 2); ++t) {
+            const auto expected = std::lower_bound(departures.begin(), departures.end(), t) - departures.begin();
+
+            REQUIRE(search::first_at_or_after(departures.data(), n, t) == static_cast<size_t>(expected));
+        }
+    }
+}
+
+
+// The footpaths from the source are only relaxed in the first round, since there is no round 0 for them.
+// Leaving the source after its last departure, no route improves a stop in the first round, but the stops
+// within walking distance of the source are still reached, so the first round must not stop before its footpaths.
+TEST_CASE("Test the footpaths from the source after its last departure", "") {
+    Timetable timetable {};
+    Raptor raptor {&timetable};
+
+    size_t n_queries = 0;
+
+    for (const auto& source: timetable.stops) {
+        if (!source.is_valid() || source.n_transfers == 0) continue;
+
+        Time last_departure {0};
+        for (const auto& stop_route: timetable.routes_of(source)) {
+            const auto& route = timetable.routes[stop_route.route_id];
+            const auto column = timetable.departures_of_stop(route, stop_route.stop_idx);
+
+            for (const auto& value: column.values) {
+                last_departure = std::max(last_departure, Time(value + column.shift));
+            }
+        }
+
+        const auto departure_time = last_departure + Time(1);
+        const auto& transfer = timetable.transfers_of(source)[0];
+        const auto target_labels = raptor.query(source.id, transfer.dest, departure_time);
+
+        REQUIRE(target_labels.size() >= 2);
+        REQUIRE(target_labels[1] <= departure_time + transfer.time);
+
+        ++n_queries;
+    }
+
+    REQUIRE(n_queries > 0);
+}
+
+
+// No journey of the range query is dominated by another one
+bool test_pareto_optimal(const std::vector<Journey>& journeys) {
+    for (const auto& j1: journeys) {
+        for (const auto& j2: journeys) {
+            if (&j1 == &j2) continue;
+
+            if (j2.dep >= j1.dep && j2.arr <= j1.arr && j2.n_transfers <= j1.n_transfers) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+// The time to walk from the source to the target without any trip, which is infinite if the target cannot be
+// reached on foot. The earliest arrival queries also find this walk, while the range query only gives journeys
+// with trips.
+Time direct_walking_time(const Timetable& timetable, const node_id_t& source_id, const node_id_t& target_id) {
+    if (use_hl) return timetable.walking_time(source_id, target_id);
+
+    for (const auto& transfer: timetable.transfers_of(timetable.stops[source_id])) {
+        if (transfer.dest == target_id) return transfer.time;
+    }
+
+    return Time();
+}
+
+
+// Leaving at any time of the window, and in particular at the departure time of each journey of the range query,
+// the earliest arrival time is that of the best journey leaving at the same time or later, unless a journey
+// leaving after the window or walking directly to the target is even better.
+// Like the other comparisons between kinds of queries, this only holds if the transfers are transitively
+// closed, as assumed by RAPTOR, otherwise the journeys depend on the round in which each footpath is taken.
+bool test_range_query(Raptor& raptor, const Timetable& timetable, const node_id_t& source_id,
+                      const node_id_t& target_id, const Time& earliest_dep, const Time& latest_dep) {
+    const auto journeys = raptor.range_query(source_id, target_id, earliest_dep, latest_dep);
+
+    if (!test_pareto_optimal(journeys)) return false;
+
+    const auto after_window = raptor.query(source_id, target_id, latest_dep + Time(1)).back();
+    const auto walking_time = direct_walking_time(timetable, source_id, target_id);
+
+    std::vector<Time> departure_times;
+    for (const auto& journey: journeys) {
+        departure_times.push_back(journey.dep);
+    }
+
+    for (Time dep = earliest_dep; dep <= latest_dep; dep = dep + Time(120)) {
+        departure_times.push_back(dep);
+    }
+
+    for (const auto& dep: departure_times) {
+        Time best_arrival_time = std::min(after_window, walking_time ? dep + walking_time : Time());
+
+        for (const auto& journey: journeys) {
+            if (journey.dep >= dep) {
+                best_arrival_time = std::min(best_arrival_time, journey.arr);
+            }
+        }
+
+        if (!(raptor.query(source_id, target_id, dep).back() == best_arrival_time)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+TEST_CASE("Test the range query against earliest arrival queries", "") {
+    // With the transfers, then with hub labelling
+    for (const auto hl: {false, true}) {
+        use_hl = hl;
+
+        Timetable timetable {};
+        Raptor raptor {&timetable};
+
+        const Time earliest_dep {8 * 3600};
+        const Time latest_dep {9 * 3600};
+
+        std::vector<node_id_t> stop_ids;
+        for (const auto& stop: timetable.stops) {
+            if (stop.is_valid()) stop_ids.push_back(stop.id);
+        }
+
+        const size_t step = std::max<size_t>(1, stop_ids.size() / 10);
+
+        for (size_t i = 0; i < stop_ids.size(); i += step) {
+            for (size_t j = step / 2; j < stop_ids.size(); j += step) {
+                if (stop_ids[i] == stop_ids[j]) continue;
+
+                REQUIRE(test_range_query(raptor, timetable, stop_ids[i], stop_ids[j], earliest_dep, latest_dep));
+            }
+        }
+    }
+
+    use_hl = false;
+}
+
+
+// The labels of the one-to-all query in its last round are the earliest arrival times at each stop,
+// and the many-to-many query gives the same travel times
+bool test_one_to_all(Raptor& raptor, const std::vector<node_id_t>& source_ids,
+                     const std::vector<node_id_t>& target_ids, const Time& departure_time) {
+    const auto travel_times = raptor.many_to_many(source_ids, target_ids, departure_time);
+
+    for (size_t i = 0; i < source_ids.size(); ++i) {
+        std::vector<Time> arrival_times;
+
+        const auto& labels = raptor.one_to_all(source_ids[i], departure_time);
+        for (const auto& target_id: target_ids) {
+            arrival_times.push_back(labels(labels.n_rounds() - 1, target_id));
+        }
+
+        for (size_t j = 0; j < target_ids.size(); ++j) {
+            const auto& arrival_time = arrival_times[j];
+
+            if (source_ids[i] == target_ids[j]) continue;
+
+            if (!(raptor.query(source_ids[i], target_ids[j], departure_time).back() == arrival_time)) {
+                return false;
+            }
+
+            if (!(travel_times[i][j] == (arrival_time ? arrival_time - departure_time : Time()))) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+TEST_CASE("Test the one-to-all and many-to-many queries against earliest arrival queries", "") {
+    Timetable timetable {};
+    Raptor raptor {&timetable};
+
+    std::vector<node_id_t> source_ids, target_ids;
+    for (const auto& stop: timetable.stops) {
+        if (!stop.is_valid()) continue;
+
+        if (stop.id % 13 == 0) source_ids.push_back(stop.id);
+        if (stop.id % 7 == 3) target_ids.push_back(stop.id);
+    }
+
+    REQUIRE(test_one_to_all(raptor, source_ids, target_ids, Time(8 * 3600)));
+
+    // The threads give the same travel times
+    REQUIRE(parallel_many_to_many(&timetable, source_ids, target_ids, Time(8 * 3600), 4) ==
+            raptor.many_to_many(source_ids, target_ids, Time(8 * 3600)));
+}
+
+
+// The walking time between two stops is the shortest walk through a hub which is an out-hub of the first stop
+// and an in-hub of the second one
+Time brute_force_walking_time(const Timetable& timetable, const node_id_t& source_id, const node_id_t& target_id) {
+    Time walking_time {};
+
+    for (const auto& out_hub: timetable.out_hubs_of(timetable.stops[source_id])) {
+        for (const auto& in_hub: timetable.in_hubs_of(timetable.stops[target_id])) {
+            if (out_hub.second == in_hub.second) {
+                walking_time = std::min(walking_time, out_hub.first + in_hub.first);
+            }
+        }
+    }
+
+    return walking_time;
+}
+
+
+TEST_CASE("Test the footpaths with hub labelling against the walking times", "") {
+    use_hl = true;
+
+    Timetable timetable {};
+    Raptor raptor {&timetable};
+
+    const Time departure_time {8 * 3600};
+
+    for (const auto& source: timetable.stops) {
+        if (!source.is_valid() || source.id % 13 != 0) continue;
+
+        // The labels in round 0 are given by walking from the source only
+        const auto& labels = raptor.one_to_all(source.id, departure_time);
+
+        for (const auto& stop: timetable.stops) {
+            if (!stop.is_valid() || stop.id == source.id) continue;
+
+            const auto walking_time = brute_force_walking_time(timetable, source.id, stop.id);
+
+            REQUIRE(labels(0, stop.id) == departure_time + walking_time);
+            REQUIRE(labels(labels.n_rounds() - 1, stop.id) <= departure_time + walking_time);
+        }
+    }
+
+    use_hl = false;
+}
+
+
+// The latest departure time of the backward query arrives at the target in time, and leaving later does not,
+// both with the forward queries
+bool test_backward_query(Raptor& raptor, const node_id_t& source_id, const node_id_t& target_id,
+                         const Time& arrival_time) {
+    const auto departure_time = raptor.backward_query(source_id, target_id, arrival_time).back();
+
+    if (departure_time == Time(Time::neg_inf)) {
+        return !(raptor.query(source_id, target_id, Time(0)).back() <= arrival_time);
+    }
+
+    return raptor.query(source_id, target_id, departure_time).back() <= arrival_time &&
+           raptor.query(source_id, target_id, departure_time + Time(1)).back() > arrival_time;
+}
+
+
+TEST_CASE("Test the backward query against earliest arrival queries", "") {
+    // With the transfers, then with hub labelling
+    for (const auto hl: {false, true}) {
+        use_hl = hl;
+
+        Timetable timetable {};
+        Raptor raptor {&timetable};
+
+        std::vector<node_id_t> stop_ids;
+        for (const auto& stop: timetable.stops) {
+            if (stop.is_valid()) stop_ids.push_back(stop.id);
+        }
+
+        const size_t step = std::max<size_t>(1, stop_ids.size() / 10);
+
+        for (size_t i = 0; i < stop_ids.size(); i += step) {
+            for (size_t j = step / 2; j < stop_ids.size(); j += step) {
+                if (stop_ids[i] == stop_ids[j]) continue;
+
+                REQUIRE(test_backward_query(raptor, stop_ids[i], stop_ids[j], Time(9 * 3600)));
+            }
+        }
+    }
+
+    use_hl = false;
+}
+
+
+// The legs go from the source to the target one after another, and arrive at the given arrival time
+bool test_legs(const std::vector<Leg>& legs, const node_id_t& source_id, const node_id_t& target_id,
+               const Time& departure_time, const Time& arrival_time) {
+    if (legs.empty() || legs.front().from != source_id || legs.back().to != target_id) return false;
+
+    Time time = departure_time;
+
+    for (const auto& leg: legs) {
+        if (leg.dep < time || leg.arr < leg.dep) return false;
+
+        time = leg.arr;
+    }
+
+    for (size_t i = 0; i + 1 < legs.size(); ++i) {
+        if (legs[i].to != legs[i + 1].from) return false;
+    }
+
+    return legs.back().arr == arrival_time;
+}
+
+
+TEST_CASE("Test the reconstruction of the journeys", "") {
+    record_journeys = true;
+
+    Timetable timetable {};
+    Raptor raptor {&timetable};
+
+    const Time departure_time {8 * 3600};
+
+    std::vector<node_id_t> stop_ids;
+    for (const auto& stop: timetable.stops) {
+        if (stop.is_valid()) stop_ids.push_back(stop.id);
+    }
+
+    const size_t step = std::max<size_t>(1, stop_ids.size() / 10);
+
+    for (size_t i = 0; i < stop_ids.size(); i += step) {
+        for (size_t j = step / 2; j < stop_ids.size(); j += step) {
+            const auto& source_id = stop_ids[i];
+            const auto& target_id = stop_ids[j];
+            if (source_id == target_id) continue;
+
+            const auto arrival_times = raptor.query(source_id, target_id, departure_time);
+
+            for (size_t round = 0; round < arrival_times.size(); ++round) {
+                if (!arrival_times[round]) continue;
+
+                REQUIRE(test_legs(raptor.journey(target_id, round), source_id, target_id,
+                                  departure_time, arrival_times[round]));
+            }
+
+            for (const auto& journey: raptor.range_query(source_id, target_id, departure_time,
+                                                         departure_time + Time(3600))) {
+                REQUIRE(test_legs(journey.legs, source_id, target_id, journey.dep, journey.arr));
+            }
+        }
+    }
+
+    record_journeys = false;
+}
+
+
+// Counting the work of the queries does not change their answers, each round is counted once,
+// and a label can only be improved by a stop event or an edge relaxed in the round
+TEST_CASE("Test the statistics of the queries", "") {
+    Timetable timetable {};
+    Raptor raptor {&timetable};
+
+    const Time departure_time {8 * 3600};
+
+    std::vector<node_id_t> stop_ids;
+    for (const auto& stop: timetable.stops) {
+        if (stop.is_valid()) stop_ids.push_back(stop.id);
+    }
+
+    const size_t step = std::max<size_t>(1, stop_ids.size() / 10);
+
+    for (size_t i = 0; i < stop_ids.size(); i += step) {
+        for (size_t j = step / 2; j < stop_ids.size(); j += step) {
+            const auto& source_id = stop_ids[i];
+            const auto& target_id = stop_ids[j];
+
+            QueryStats stats;
+            const auto arrival_times = raptor.query(source_id, target_id, departure_time, &stats);
+
+            REQUIRE(arrival_times == raptor.query(source_id, target_id, departure_time));
+            REQUIRE(stats.size() + 1 == arrival_times.size());
+            REQUIRE(stats.front().marked_stops == 1);
+
+            for (const auto& round_stats: stats) {
+                REQUIRE(round_stats.improved_labels <= round_stats.visited_events + round_stats.relaxed_edges);
+            }
+        }
+    }
+}